@@ -0,0 +1,136 @@
+// Compares per-request allocations and latency of Synthesize with and
+// without sequence-length bucketing, over phoneme id sequences of varying
+// length. Prints one TSV row per configuration:
+//   config  mean_ms  p50_ms  p99_ms  mallocs_per_call  malloc_mb_per_call
+//
+// "off" is the default tuning (no arena, no memory pattern). "arena" enables
+// both without bucketing, so every new input length still gets a new plan.
+// "bucketed" adds padding to defaultLengthBuckets(), so onnxruntime can
+// replay one allocation plan per bucket; the gap between the last two rows
+// is what bucketing itself buys.
+//
+// "bound" is "bucketed" through BoundInference (IoBinding), which reuses its
+// input buffers but not the output; see InferenceCounters.
+//
+// Allocations are counted by bench/malloc_counter.cpp.
+//
+// Usage: vits_bucketing_bench [model.onnx] [requests]
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bound_inference.h"
+#include "cold_start.h"
+#include "metrics.h"
+#include "vits_onnx.h"
+
+struct BucketingStats {
+  double meanMs = 0;
+  double p50Ms = 0;
+  double p99Ms = 0;
+  double mallocsPerCall = 0;
+  double mallocBytesPerCall = 0;
+};
+
+static BucketingStats measure(const std::string &modelPath, const SessionTuning &tuning,
+                              bool useIoBinding,
+                              const std::vector<std::vector<int64_t>> &requests) {
+    ModelSession session;
+    session.tuning = tuning;
+    loadModel(modelPath, session, false);
+    BoundInference bound(session);
+
+    SynthesisConfig synthesisConfig;
+    std::vector<int16_t> audioBuffer;
+    auto synthesize = [&](const std::vector<int64_t> &ids) {
+        SynthesisResult result;
+        if (useIoBinding) {
+            bound.run(ids.data(), ids.size(), synthesisConfig, result);
+            return;
+        }
+        std::vector<int64_t> phonemeIds = ids;
+        audioBuffer.clear();
+        Synthesize(phonemeIds, synthesisConfig, session, audioBuffer, result);
+    };
+
+    // One untimed pass so every bucket has been planned once
+    for (const std::vector<int64_t> &ids : requests) {
+        synthesize(ids);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(requests.size());
+    uint64_t startCount = 0, startBytes = 0;
+    processAllocations(startCount, startBytes);
+    for (const std::vector<int64_t> &ids : requests) {
+        auto startTime = std::chrono::steady_clock::now();
+        synthesize(ids);
+        auto endTime = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+    }
+    uint64_t count = 0, bytes = 0;
+    processAllocations(count, bytes);
+    count -= startCount;
+    bytes -= startBytes;
+
+    BucketingStats stats;
+    for (double sample : samples) {
+        stats.meanMs += sample;
+    }
+    stats.meanMs /= (double)samples.size();
+    std::sort(samples.begin(), samples.end());
+    stats.p50Ms = samples[(samples.size() - 1) / 2];
+    stats.p99Ms = samples[std::min(samples.size() - 1,
+                                   (size_t)(0.99 * (double)samples.size()))];
+    stats.mallocsPerCall = (double)count / (double)requests.size();
+    stats.mallocBytesPerCall = (double)bytes / (double)requests.size();
+    return stats;
+}
+
+int main(int argc, char **argv) {
+    std::string modelPath = (argc > 1) ? argv[1] : "vits2_model.onnx";
+    size_t numRequests = (argc > 2) ? std::stoul(argv[2]) : 50;
+    if (numRequests == 0) {
+        numRequests = 1;
+    }
+
+    // Lengths spread over the buckets, the same sequence for every run
+    std::vector<std::vector<int64_t>> requests;
+    uint32_t state = 12345;
+    for (size_t i = 0; i < numRequests; i++) {
+        state = state * 1664525u + 1013904223u;
+        requests.push_back(warmupSequence(8 + (state >> 8) % 300));
+    }
+
+    SessionTuning off;
+    loadSessionTuning(defaultTuningPath(modelPath), off);
+    off.lengthBuckets.clear();
+    off.cpuMemArena = false;
+    off.memPattern = false;
+
+    SessionTuning arena = off;
+    arena.cpuMemArena = true;
+    arena.memPattern = true;
+
+    SessionTuning bucketed = arena;
+    bucketed.lengthBuckets = defaultLengthBuckets();
+
+    std::cout << "config\tmean_ms\tp50_ms\tp99_ms\tmallocs_per_call\tmalloc_mb_per_call"
+              << std::endl;
+    struct Config {
+      const char *name;
+      SessionTuning tuning;
+      bool useIoBinding;
+    };
+    for (const Config &config : {Config{"off", off, false}, Config{"arena", arena, false},
+                                 Config{"bucketed", bucketed, false},
+                                 Config{"bound", bucketed, true}}) {
+        BucketingStats stats = measure(modelPath, config.tuning, config.useIoBinding, requests);
+        std::cout << config.name << "\t" << stats.meanMs << "\t" << stats.p50Ms << "\t"
+                  << stats.p99Ms << "\t" << stats.mallocsPerCall << "\t"
+                  << stats.mallocBytesPerCall / (1024.0 * 1024.0) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+// Counts every malloc, calloc and posix_memalign of the process, for benches
+// that report allocations (see processAllocations in metrics.h).
+// onnxruntime allocates through these rather than operator new. glibc only.
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+static std::atomic<uint64_t> mallocCount{0};
+static std::atomic<uint64_t> mallocBytes{0};
+
+static void countAllocation(size_t size) {
+    mallocCount.fetch_add(1, std::memory_order_relaxed);
+    mallocBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size) {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" int posix_memalign(void **result, size_t alignment, size_t size) {
+    countAllocation(size);
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *result = p;
+    return 0;
+}
+
+extern "C" void vitsMallocCounts(uint64_t *count, uint64_t *bytes) {
+    *count = mallocCount.load(std::memory_order_relaxed);
+    *bytes = mallocBytes.load(std::memory_order_relaxed);
+}
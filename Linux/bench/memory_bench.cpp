@@ -0,0 +1,104 @@
+// Measures how the resident set peak of one request grows with input length,
+// with and without a per-Run MemoryBudget, and prints one TSV row per run:
+//   ids  budget_mb  runs  samples  peak_mb  predicted_mb
+//
+// The input is one long clause without punctuation, the case that clause
+// splitting alone can't bound. peak_mb is the resident set peak above the
+// loaded model (each row loads a fresh session, so arenas start empty) and
+// predicted_mb what the default MemoryBudget estimates for the largest Run
+// (padded to its length bucket). The last line fits samplesPerId and
+// bytesPerSample for this model from the unbounded rows; set them on the
+// session's MemoryBudget in place of the uncalibrated defaults.
+//
+// Usage: vits_memory_bench [model.onnx] [budget_mb=64] [max_ids=1600]
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+#include "silence.h"
+#include "symbols.h"
+#include "vits_onnx.h"
+
+struct MemoryRow {
+  size_t runs = 0;
+  size_t samples = 0;
+  uint64_t peakBytes = 0;
+  uint64_t predictedBytes = 0;
+
+  // Padded length of the longest Run
+  size_t runIds = 0;
+};
+
+static MemoryRow measure(const std::string &modelPath, std::vector<int64_t> phonemeIds,
+                         uint64_t budgetBytes) {
+    SynthesisConfig synthesisConfig;
+    synthesisConfig.sentenceSilenceSeconds = 0;
+    synthesisConfig.trimSilence = false;
+
+    ModelSession session;
+    session.memoryBudget.maxBytes = budgetBytes;
+    loadSessionTuning(defaultTuningPath(modelPath), session.tuning);
+    loadModel(modelPath, session, false);
+
+    uint64_t baseline = residentMemoryBytes();
+    uint64_t runsBefore = metrics().stage(Stage::Run).count();
+    PeakMemoryScope memoryScope;
+    std::vector<int16_t> audioBuffer;
+    SynthesisResult result;
+    SynthesizeClauses(phonemeIds, synthesisConfig, session, audioBuffer, result);
+
+    MemoryRow row;
+    row.runs = metrics().stage(Stage::Run).count() - runsBefore;
+    row.samples = audioBuffer.size();
+    uint64_t peak = memoryScope.peakBytes();
+    row.peakBytes = (peak > baseline) ? peak - baseline : 0;
+    row.predictedBytes = predictedRunBytes(session, result.longestRunIds, synthesisConfig);
+    row.runIds = (size_t)bucketLength(session.tuning, (int64_t)result.longestRunIds);
+    return row;
+}
+
+int main(int argc, char **argv) {
+    std::string modelPath = (argc > 1) ? argv[1] : "vits2_model.onnx";
+    uint64_t budgetBytes = ((argc > 2) ? std::stoull(argv[2]) : 64) << 20;
+    size_t maxIds = (argc > 3) ? std::stoul(argv[3]) : 1600;
+
+    initializeESpeak("espeak-ng/share/espeak-ng-data/");
+    eSpeakPhonemeConfig eSpeakConfig;
+    std::vector<int64_t> words = text_to_sequence(
+        "and the quiet river kept on running past the old mill ", eSpeakConfig);
+    // Drop the period phonemize_eSpeak ends the text with
+    words.pop_back();
+    // Repeats are joined by a word break, or "mill" would run into "and"
+    std::vector<int64_t> clause;
+    while (clause.size() < maxIds) {
+        if (!clause.empty()) {
+            clause.push_back(symbolToId(U' '));
+        }
+        clause.insert(clause.end(), words.begin(), words.end());
+    }
+
+    const double MB = 1024.0 * 1024.0;
+    double samplesPerId = 0;
+    double bytesPerSample = 0;
+
+    std::cout << "ids\tbudget_mb\truns\tsamples\tpeak_mb\tpredicted_mb" << std::endl;
+    for (size_t numIds = 100; numIds <= maxIds; numIds *= 2) {
+        std::vector<int64_t> phonemeIds(clause.begin(), clause.begin() + numIds);
+        for (uint64_t budget : {(uint64_t)0, budgetBytes}) {
+            MemoryRow row = measure(modelPath, phonemeIds, budget);
+            std::cout << numIds << "\t" << (double)budget / MB << "\t" << row.runs << "\t"
+                      << row.samples << "\t" << (double)row.peakBytes / MB << "\t"
+                      << (double)row.predictedBytes / MB << std::endl;
+            if (budget == 0 && row.samples > 0) {
+                samplesPerId = std::max(samplesPerId, (double)row.samples / (double)row.runIds);
+                bytesPerSample =
+                    std::max(bytesPerSample, (double)row.peakBytes / (double)row.samples);
+            }
+        }
+    }
+    std::cout << "# fit: samplesPerId=" << samplesPerId << " bytesPerSample=" << bytesPerSample
+              << std::endl;
+    return 0;
+}
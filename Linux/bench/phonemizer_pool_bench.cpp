@@ -0,0 +1,76 @@
+// Measures G2P throughput with N caller threads, phonemizing in-process
+// under eSpeakMutex versus on a PhonemizerPool of N helper processes.
+//
+// Usage: vits_phonemizer_bench [max threads] [texts per thread]
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "phonemizer_pool.h"
+#include "vits_onnx.h"
+
+int main(int argc, char **argv) {
+    size_t maxThreads = (argc > 1) ? std::stoul(argv[1]) : std::thread::hardware_concurrency();
+    size_t textsPerThread = (argc > 2) ? std::stoul(argv[2]) : 50;
+    if (maxThreads == 0) {
+        maxThreads = 1;
+    }
+
+    const std::vector<std::string> texts = {
+        "Hello there.",
+        "The quick brown fox jumps over the lazy dog, "
+        "while the patient cat waits by the window.",
+        "It was a bright cold day in April, and the clocks were striking thirteen.",
+    };
+    const std::string espeakDataPath = "espeak-ng/share/espeak-ng-data/";
+
+    // Fork every pool before any thread is started
+    std::vector<std::unique_ptr<PhonemizerPool>> pools;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        PhonemizerPoolConfig config;
+        config.numWorkers = threads;
+        config.espeakDataPath = espeakDataPath;
+        pools.push_back(std::make_unique<PhonemizerPool>(config));
+    }
+    initializeESpeak(espeakDataPath);
+
+    std::cout << "mode\tthreads\ttexts\twall_s\ttexts_per_s" << std::endl;
+    for (const char *mode : {"in_process", "pool"}) {
+        size_t poolIndex = 0;
+        for (size_t threads = 1; threads <= maxThreads; threads *= 2, poolIndex++) {
+            PhonemizerPool &pool = *pools[poolIndex];
+            bool usePool = (std::string(mode) == "pool");
+
+            auto startTime = std::chrono::steady_clock::now();
+            std::vector<std::thread> callers;
+            for (size_t t = 0; t < threads; t++) {
+                callers.emplace_back([&, t]() {
+                    eSpeakPhonemeConfig eSpeakConfig;
+                    for (size_t i = 0; i < textsPerThread; i++) {
+                        const std::string &text = texts[(t + i) % texts.size()];
+                        if (usePool) {
+                            pool.textToSequence(text, eSpeakConfig);
+                        } else {
+                            std::lock_guard<std::mutex> lock(eSpeakMutex());
+                            text_to_sequence(text, eSpeakConfig);
+                        }
+                    }
+                });
+            }
+            for (std::thread &caller : callers) {
+                caller.join();
+            }
+            auto endTime = std::chrono::steady_clock::now();
+
+            double wallSeconds = std::chrono::duration<double>(endTime - startTime).count();
+            size_t numTexts = threads * textsPerThread;
+            std::cout << mode << "\t" << threads << "\t" << numTexts << "\t" << wallSeconds
+                      << "\t" << (double)numTexts / wallSeconds << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+// Compares the reduced-precision exports of a model (see findModelVariants)
+// against its fp32 graph on the same phoneme id corpus and prints one TSV
+// row per variant:
+//   precision  load_s  rtf  peak_rss_mb  snr_db  length_mismatches  length_diff
+//
+// Noise scales are zeroed so every variant decodes the same latent, and gain
+// is fixed so the int16 outputs can be compared sample by sample. snr_db is
+// the fp32 signal energy over the energy of the difference, taken only over
+// items of the same length as their fp32 output (nan if there are none):
+// once the duration predictor disagrees the samples are misaligned and the
+// difference measures drift, not precision. length_mismatches counts the
+// other items and length_diff their total difference in samples.
+//
+// Usage: vits_precision_bench [model.onnx] [corpus.txt] [iterations]
+//   corpus.txt: one sequence of space separated phoneme ids per line
+//   (defaults to a few phonemized sentences)
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+#include "vits_onnx.h"
+
+struct VariantReport {
+  ModelPrecision precision;
+  double loadSeconds = 0;
+  double realTimeFactor = 0;
+  uint64_t peakResidentBytes = 0;
+  double snrDb = 0;
+  size_t lengthMismatches = 0;
+  int64_t lengthDiff = 0;
+};
+
+static std::vector<std::vector<int64_t>> readCorpus(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open corpus " + path);
+    }
+    std::vector<std::vector<int64_t>> corpus;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream ids(line);
+        std::vector<int64_t> sequence;
+        int64_t id;
+        while (ids >> id) {
+            sequence.push_back(id);
+        }
+        if (!sequence.empty()) {
+            corpus.push_back(std::move(sequence));
+        }
+    }
+    return corpus;
+}
+
+static VariantReport runVariant(const std::string &modelPath, ModelPrecision precision,
+                                const std::vector<std::vector<int64_t>> &corpus,
+                                size_t iterations,
+                                std::vector<std::vector<int16_t>> &outputs) {
+    VariantReport report;
+    report.precision = precision;
+
+    // Lets VmHWM measure each variant on its own instead of the process lifetime
+    resetPeakResidentMemory();
+
+    SynthesisConfig synthesisConfig;
+    synthesisConfig.noiseScale = 0.0f;
+    synthesisConfig.noiseW = 0.0f;
+    synthesisConfig.gainMode = GainMode::Fixed;
+    synthesisConfig.fixedGain = 1.0f;
+
+    auto loadStart = std::chrono::steady_clock::now();
+    ModelSession session;
+    loadSessionTuning(defaultTuningPath(modelPath), session.tuning);
+    loadModel(modelPath, session, false);
+    report.loadSeconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - loadStart)
+                             .count();
+
+    double inferSeconds = 0;
+    double audioSeconds = 0;
+    outputs.assign(corpus.size(), {});
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t c = 0; c < corpus.size(); c++) {
+            std::vector<int64_t> phonemeIds = corpus[c];
+            std::vector<int16_t> audioBuffer;
+            SynthesisResult result;
+            Synthesize(phonemeIds, synthesisConfig, session, audioBuffer, result);
+            inferSeconds += result.inferSeconds;
+            audioSeconds += result.audioSeconds;
+            if (i == 0) {
+                outputs[c] = std::move(audioBuffer);
+            }
+        }
+    }
+    report.realTimeFactor = (audioSeconds > 0) ? inferSeconds / audioSeconds : 0.0;
+    report.peakResidentBytes = peakResidentMemoryBytes();
+    return report;
+}
+
+static void compareOutputs(const std::vector<std::vector<int16_t>> &reference,
+                           const std::vector<std::vector<int16_t>> &outputs,
+                           VariantReport &report) {
+    double signal = 0;
+    double noise = 0;
+    size_t compared = 0;
+    for (size_t c = 0; c < reference.size(); c++) {
+        if (reference[c].size() != outputs[c].size()) {
+            report.lengthMismatches++;
+            report.lengthDiff += std::abs((int64_t)reference[c].size() -
+                                          (int64_t)outputs[c].size());
+            continue;
+        }
+        for (size_t i = 0; i < reference[c].size(); i++) {
+            double expected = reference[c][i];
+            double difference = expected - (double)outputs[c][i];
+            signal += expected * expected;
+            noise += difference * difference;
+        }
+        compared++;
+    }
+    if (compared == 0) {
+        report.snrDb = std::numeric_limits<double>::quiet_NaN();
+    } else {
+        report.snrDb = (noise > 0) ? 10.0 * std::log10(signal / noise)
+                                   : std::numeric_limits<double>::infinity();
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string modelPath = (argc > 1) ? argv[1] : "vits2_model.onnx";
+    std::string corpusPath = (argc > 2) ? argv[2] : "";
+    size_t iterations = (argc > 3) ? std::stoul(argv[3]) : 5;
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    std::vector<std::vector<int64_t>> corpus;
+    if (!corpusPath.empty()) {
+        corpus = readCorpus(corpusPath);
+    } else {
+        initializeESpeak("espeak-ng/share/espeak-ng-data/");
+        eSpeakPhonemeConfig eSpeakConfig;
+        for (const char *text :
+             {"Hello there.",
+              "The quick brown fox jumps over the lazy dog, "
+              "while the patient cat waits by the window.",
+              "It was a bright cold day in April, and the clocks were striking "
+              "thirteen."}) {
+            corpus.push_back(text_to_sequence(text, eSpeakConfig));
+        }
+    }
+    if (corpus.empty()) {
+        std::cerr << "Empty corpus" << std::endl;
+        return 1;
+    }
+
+    std::vector<ModelPrecision> variants = findModelVariants(modelPath);
+    if (variants.empty() || variants.front() != ModelPrecision::Float32) {
+        std::cerr << "Missing fp32 model " << modelPath << std::endl;
+        return 1;
+    }
+
+    std::cout << "precision\tload_s\trtf\tpeak_rss_mb\tsnr_db\tlength_mismatches\tlength_diff"
+              << std::endl;
+    std::vector<std::vector<int16_t>> reference;
+    for (ModelPrecision precision : variants) {
+        std::vector<std::vector<int16_t>> outputs;
+        VariantReport report = runVariant(modelVariantPath(modelPath, precision),
+                                          precision, corpus, iterations, outputs);
+        if (precision == ModelPrecision::Float32) {
+            reference = std::move(outputs);
+            report.snrDb = std::numeric_limits<double>::infinity();
+        } else {
+            compareOutputs(reference, outputs, report);
+        }
+
+        std::cout << precisionName(report.precision) << "\t" << report.loadSeconds
+                  << "\t" << report.realTimeFactor << "\t"
+                  << (double)report.peakResidentBytes / (1024.0 * 1024.0) << "\t"
+                  << report.snrDb << "\t" << report.lengthMismatches << "\t"
+                  << report.lengthDiff << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Measures what resampling to other output rates costs next to Session::Run.
+// Synthesizes a few sentences at the model's rate, then streams the same
+// audio through a Resampler per target rate in decoder-sized chunks and
+// prints one TSV row per rate:
+//   rate  kernel  run_ms  resample_ms  resample_vs_run  realtime_x
+//
+// run_ms is the Run stage total for the sentences, resample_ms the time to
+// resample all of their audio, resample_vs_run the ratio of the two and
+// realtime_x the seconds of audio resampled per second.
+//
+// Usage: vits_resampler_bench [model.onnx] [rates=8000,16000,48000] [iterations]
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+#include "resampler.h"
+#include "vits_onnx.h"
+
+// Samples per process() call; about what one ChunkedDecoder chunk yields
+static const size_t CHUNK_SAMPLES = 8192;
+
+static std::vector<int> parseRates(const std::string &list) {
+    std::vector<int> rates;
+    std::istringstream stream(list);
+    std::string rate;
+    while (std::getline(stream, rate, ',')) {
+        if (!rate.empty()) {
+            rates.push_back(std::stoi(rate));
+        }
+    }
+    return rates;
+}
+
+int main(int argc, char **argv) {
+    std::string modelPath = (argc > 1) ? argv[1] : "vits2_model.onnx";
+    std::vector<int> rates = parseRates((argc > 2) ? argv[2] : "8000,16000,48000");
+    size_t iterations = (argc > 3) ? std::stoul(argv[3]) : 5;
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    initializeESpeak("espeak-ng/share/espeak-ng-data/");
+    eSpeakPhonemeConfig eSpeakConfig;
+    SynthesisConfig synthesisConfig;
+    ModelSession session;
+    loadSessionTuning(defaultTuningPath(modelPath), session.tuning);
+    loadModel(modelPath, session, false);
+
+    std::vector<std::vector<int16_t>> outputs;
+    double audioSeconds = 0;
+    double runSeconds = metrics().stage(Stage::Run).sumSeconds();
+    for (const char *text :
+         {"Hello there.",
+          "The quick brown fox jumps over the lazy dog, "
+          "while the patient cat waits by the window.",
+          "It was a bright cold day in April, and the clocks were striking "
+          "thirteen."}) {
+        std::vector<int64_t> phonemeIds = text_to_sequence(text, eSpeakConfig);
+        std::vector<int16_t> audioBuffer;
+        SynthesisResult result;
+        Synthesize(phonemeIds, synthesisConfig, session, audioBuffer, result);
+        audioSeconds += result.audioSeconds;
+        outputs.push_back(std::move(audioBuffer));
+    }
+    runSeconds = metrics().stage(Stage::Run).sumSeconds() - runSeconds;
+
+    std::cout << "rate\tkernel\trun_ms\tresample_ms\tresample_vs_run\trealtime_x"
+              << std::endl;
+    for (int rate : rates) {
+        Resampler resampler(synthesisConfig.sampleRate, rate);
+        std::vector<int16_t> resampled;
+        resampled.reserve(CHUNK_SAMPLES * rate / synthesisConfig.sampleRate + 64);
+
+        // The first pass also builds the filter bank; time the rest
+        double resampleSeconds = 0;
+        for (size_t i = 0; i <= iterations; i++) {
+            auto startTime = std::chrono::steady_clock::now();
+            for (const std::vector<int16_t> &audio : outputs) {
+                for (size_t offset = 0; offset < audio.size(); offset += CHUNK_SAMPLES) {
+                    size_t count = std::min(CHUNK_SAMPLES, audio.size() - offset);
+                    resampled.clear();
+                    resampler.process(audio.data() + offset, count, resampled);
+                }
+                resampled.clear();
+                resampler.flush(resampled);
+            }
+            if (i > 0) {
+                resampleSeconds += std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() - startTime)
+                                       .count();
+            }
+        }
+        resampleSeconds /= (double)iterations;
+
+        std::cout << rate << "\t" << resamplerKernelName() << "\t" << runSeconds * 1000.0
+                  << "\t" << resampleSeconds * 1000.0 << "\t"
+                  << (runSeconds > 0 ? resampleSeconds / runSeconds : 0.0) << "\t"
+                  << (resampleSeconds > 0 ? audioSeconds / resampleSeconds : 0.0)
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Measures how synthesis throughput scales with the number of SessionPool
+// workers, for both pool modes.
+//
+// Usage: vits_pool_bench [model.onnx] [max workers] [requests per worker]
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "session_pool.h"
+
+static const char *modeName(SessionPoolMode mode) {
+    return (mode == SessionPoolMode::SharedSession) ? "shared" : "separate";
+}
+
+int main(int argc, char **argv) {
+    std::string modelPath = (argc > 1) ? argv[1] : "vits2_model.onnx";
+    size_t maxWorkers = (argc > 2) ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+    size_t requestsPerWorker = (argc > 3) ? std::stoul(argv[3]) : 8;
+    if (maxWorkers == 0) {
+        maxWorkers = 1;
+    }
+
+    // espeak-ng is process-global, so phonemize once up front and only
+    // exercise the sessions from the worker threads
+    initializeESpeak("espeak-ng/share/espeak-ng-data/");
+    eSpeakPhonemeConfig eSpeakConfig;
+    std::vector<int64_t> phonemeIds = text_to_sequence(
+        "The quick brown fox jumps over the lazy dog, "
+        "while the patient cat waits by the window.", eSpeakConfig);
+
+    std::cout << "mode\tworkers\trequests\twall_s\trequests_per_s\taudio_s_per_s" << std::endl;
+    for (SessionPoolMode mode : {SessionPoolMode::SeparateSessions,
+                                 SessionPoolMode::SharedSession}) {
+        for (size_t workers = 1; workers <= maxWorkers; workers *= 2) {
+            SessionPoolConfig config;
+            config.numWorkers = workers;
+            config.mode = mode;
+            SessionPool pool(modelPath, config);
+
+            std::vector<double> audioSeconds(workers, 0);
+            auto startTime = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (size_t w = 0; w < workers; w++) {
+                threads.emplace_back([&, w]() {
+                    SynthesisConfig synthesisConfig;
+                    for (size_t r = 0; r < requestsPerWorker; r++) {
+                        std::vector<int64_t> ids = phonemeIds;
+                        std::vector<int16_t> audio;
+                        SynthesisResult result;
+                        pool.synthesize(ids, synthesisConfig, audio, result);
+                        audioSeconds[w] += result.audioSeconds;
+                    }
+                });
+            }
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+            auto endTime = std::chrono::steady_clock::now();
+            double wallSeconds = std::chrono::duration<double>(endTime - startTime).count();
+
+            double totalAudio = 0;
+            for (double seconds : audioSeconds) {
+                totalAudio += seconds;
+            }
+            size_t requests = workers * requestsPerWorker;
+            std::cout << modeName(mode) << "\t" << workers << "\t" << requests << "\t"
+                      << wallSeconds << "\t" << requests / wallSeconds << "\t"
+                      << totalAudio / wallSeconds << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Compares the old wstring_convert + unordered_map symbol mapping against the
+// constexpr table with direct UTF-8 decoding, per phoneme character.
+//
+// Usage: vits_symbols_bench [paragraph repeats] [iterations]
+#include <chrono>
+#include <codecvt>
+#include <iostream>
+#include <locale>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "symbols.h"
+
+// The previous implementation, kept here as the baseline
+static std::vector<int64_t> legacyToSequence(const std::string &phonemes,
+                                             std::unordered_map<char16_t, int> &symbolToId) {
+    std::vector<int64_t> sequence;
+    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    std::wstring wide = converter.from_bytes(phonemes);
+    for (char16_t symbol : wide) {
+        if (symbolToId.count(symbol) > 0) {
+            sequence.push_back(symbolToId[symbol]);
+        }
+    }
+    return sequence;
+}
+
+int main(int argc, char **argv) {
+    size_t repeats = (argc > 1) ? std::stoul(argv[1]) : 200;
+    size_t iterations = (argc > 2) ? std::stoul(argv[2]) : 20;
+
+    std::unordered_map<char16_t, int> symbolToId;
+    for (size_t id = 0; id < NUM_SYMBOLS; id++) {
+        if (SYMBOLS[id] != 0) {
+            symbolToId[(char16_t)SYMBOLS[id]] = (int)id;
+        }
+    }
+
+    const std::string paragraph =
+        "ðə kwˈɪk bɹˈaʊn fˈɑːks dʒˈʌmps ˌoʊvɚ ðə lˈeɪzi dˈɑːɡ, wˌaɪl ðə pˈeɪʃənt kˈæt "
+        "wˈeɪts baɪ ðə wˈɪndoʊ. ɪt wʌz ðə bˈɛst ʌv tˈaɪmz, ɪt wʌz ðə wˈɜːst ʌv tˈaɪmz; "
+        "ˈɔːl θˈɪŋz kənsˈɪdɚd, hiː tʃˈoʊz ðə lˈɔŋɡɚ ɹˈoʊd hˈoʊm!";
+    std::string phonemes;
+    for (size_t i = 0; i < repeats; i++) {
+        phonemes += paragraph;
+    }
+
+    std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> counter;
+    size_t numChars = counter.from_bytes(phonemes).size();
+
+    std::vector<int64_t> legacyIds, tableIds;
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        legacyIds = legacyToSequence(phonemes, symbolToId);
+    }
+    auto legacyTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        tableIds.clear();
+        utf8ToSymbolIds(phonemes.data(), phonemes.size(), tableIds);
+    }
+    auto tableTime = std::chrono::steady_clock::now();
+
+    double legacyNs = std::chrono::duration<double, std::nano>(legacyTime - startTime).count() /
+                      (double)(iterations * numChars);
+    double tableNs = std::chrono::duration<double, std::nano>(tableTime - legacyTime).count() /
+                     (double)(iterations * numChars);
+
+    std::cout << "characters: " << numChars << std::endl;
+    std::cout << "legacy ns/char: " << legacyNs << std::endl;
+    std::cout << "table ns/char: " << tableNs << std::endl;
+    std::cout << "speedup: " << legacyNs / tableNs << "x" << std::endl;
+    if (legacyIds != tableIds) {
+        std::cerr << "Mismatch between legacy and table ids" << std::endl;
+        return 1;
+    }
+    return 0;
+}
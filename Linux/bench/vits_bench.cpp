@@ -0,0 +1,230 @@
+// Benchmarks each synthesis stage on its own over short, medium and long
+// inputs and prints the results as JSON:
+//   phonemize -> symbols -> tensors -> run -> int16 -> wav
+//
+// Latencies are in milliseconds; allocations are counted per call by the
+// replaced global operator new below.
+//
+// Usage: vits_bench [model.onnx] [iterations] [output.json]
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "audio_convert.h"
+#include "vits_onnx.h"
+#include "wavfile.hpp"
+
+static std::atomic<uint64_t> allocationCount{0};
+static std::atomic<uint64_t> allocationBytes{0};
+
+void *operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+struct CorpusEntry {
+  const char *name;
+  std::string text;
+};
+
+struct StageStats {
+  std::string name;
+  double meanMs = 0;
+  double p50Ms = 0;
+  double p99Ms = 0;
+  double allocationsPerCall = 0;
+  double allocatedBytesPerCall = 0;
+};
+
+// Runs fn iterations times after one untimed call
+static StageStats measureStage(const std::string &name, size_t iterations,
+                               const std::function<void()> &fn) {
+    fn();
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    uint64_t startCount = allocationCount.load();
+    uint64_t startBytes = allocationBytes.load();
+    for (size_t i = 0; i < iterations; i++) {
+        auto startTime = std::chrono::steady_clock::now();
+        fn();
+        auto endTime = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+    }
+    // The samples vector was reserved up front, so it adds nothing here
+    uint64_t count = allocationCount.load() - startCount;
+    uint64_t bytes = allocationBytes.load() - startBytes;
+
+    StageStats stats;
+    stats.name = name;
+    for (double sample : samples) {
+        stats.meanMs += sample;
+    }
+    stats.meanMs /= (double)iterations;
+    std::sort(samples.begin(), samples.end());
+    stats.p50Ms = samples[(samples.size() - 1) / 2];
+    stats.p99Ms = samples[std::min(samples.size() - 1,
+                                   (size_t)(0.99 * (double)samples.size()))];
+    stats.allocationsPerCall = (double)count / (double)iterations;
+    stats.allocatedBytesPerCall = (double)bytes / (double)iterations;
+    return stats;
+}
+
+int main(int argc, char **argv) {
+    std::string modelPath = (argc > 1) ? argv[1] : "vits2_model.onnx";
+    size_t iterations = (argc > 2) ? std::stoul(argv[2]) : 20;
+    std::string outputPath = (argc > 3) ? argv[3] : "";
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    const std::vector<CorpusEntry> corpus = {
+        {"short", "Hello there."},
+        {"medium", "The quick brown fox jumps over the lazy dog, "
+                   "while the patient cat waits by the window."},
+        {"long", "It was a bright cold day in April, and the clocks were striking "
+                 "thirteen. Winston Smith, his chin nuzzled into his breast in an "
+                 "effort to escape the vile wind, slipped quickly through the glass "
+                 "doors of Victory Mansions, though not quickly enough to prevent a "
+                 "swirl of gritty dust from entering along with him. The hallway "
+                 "smelt of boiled cabbage and old rag mats."},
+    };
+
+    initializeESpeak("espeak-ng/share/espeak-ng-data/");
+    ModelSession session;
+    loadSessionTuning(defaultTuningPath(modelPath), session.tuning);
+    loadModel(modelPath, session, false);
+
+    eSpeakPhonemeConfig eSpeakConfig;
+    SynthesisConfig synthesisConfig;
+    auto memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator,
+                                                 OrtMemType::OrtMemTypeDefault);
+    std::array<const char *, 3> inputNames = {"input", "input_lengths", "scales"};
+    std::array<const char *, 1> outputNames = {"output"};
+    std::string wavPath = "vits_bench.wav";
+
+    // At debug log level phonemize_eSpeak echoes its result; keep it out of the JSON
+    std::ostringstream discarded;
+    std::streambuf *stdoutBuffer = std::cout.rdbuf(discarded.rdbuf());
+
+    std::ostringstream json;
+    json << "{\n  \"model\": \"" << modelPath << "\",\n"
+         << "  \"iterations\": " << iterations << ",\n"
+         << "  \"audio_kernel\": \"" << audioKernelName() << "\",\n"
+         << "  \"corpus\": [";
+
+    for (size_t c = 0; c < corpus.size(); c++) {
+        const CorpusEntry &entry = corpus[c];
+        std::vector<StageStats> stages;
+
+        std::string phonemes;
+        stages.push_back(measureStage("phonemize", iterations, [&]() {
+            phonemes = phonemize_eSpeak(entry.text, eSpeakConfig);
+        }));
+
+        std::vector<int64_t> phonemeIds;
+        stages.push_back(measureStage("symbols", iterations, [&]() {
+            phonemeIds = phonemes_to_sequence(phonemes);
+        }));
+
+        std::vector<int64_t> phonemeIdLengths{(int64_t)phonemeIds.size()};
+        std::vector<float> scales{synthesisConfig.noiseScale, synthesisConfig.lengthScale,
+                                  synthesisConfig.noiseW};
+        std::vector<int64_t> phonemeIdsShape{1, (int64_t)phonemeIds.size()};
+        std::vector<int64_t> lengthsShape{1};
+        std::vector<int64_t> scalesShape{(int64_t)scales.size()};
+        std::vector<Ort::Value> inputTensors;
+        auto setupTensors = [&]() {
+            inputTensors.clear();
+            inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+                memoryInfo, phonemeIds.data(), phonemeIds.size(), phonemeIdsShape.data(),
+                phonemeIdsShape.size()));
+            inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+                memoryInfo, phonemeIdLengths.data(), phonemeIdLengths.size(),
+                lengthsShape.data(), lengthsShape.size()));
+            inputTensors.push_back(Ort::Value::CreateTensor<float>(
+                memoryInfo, scales.data(), scales.size(), scalesShape.data(),
+                scalesShape.size()));
+        };
+        inputTensors.reserve(3);
+        stages.push_back(measureStage("tensors", iterations, setupTensors));
+
+        std::vector<float> audio;
+        stages.push_back(measureStage("run", iterations, [&]() {
+            auto outputTensors = session.onnx.Run(
+                Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(),
+                inputTensors.size(), outputNames.data(), outputNames.size());
+            auto audioShape = outputTensors.front().GetTensorTypeAndShapeInfo().GetShape();
+            const float *data = outputTensors.front().GetTensorData<float>();
+            audio.assign(data, data + audioShape.back());
+        }));
+        double audioSeconds = (double)audio.size() / (double)synthesisConfig.sampleRate;
+
+        std::vector<int16_t> samples(audio.size());
+        AudioConverter converter(synthesisConfig.gainMode, synthesisConfig.fixedGain);
+        stages.push_back(measureStage("int16", iterations, [&]() {
+            converter.convert(audio.data(), audio.size(), samples.data());
+        }));
+
+        stages.push_back(measureStage("wav", iterations, [&]() {
+            std::ofstream audioFile(wavPath, std::ios::binary);
+            writeWavHeader(synthesisConfig.sampleRate, synthesisConfig.sampleWidth,
+                           synthesisConfig.channels, (uint32_t)samples.size(), audioFile);
+            audioFile.write((const char *)samples.data(), sizeof(int16_t) * samples.size());
+        }));
+
+        double totalMs = 0;
+        for (const StageStats &stage : stages) {
+            totalMs += stage.meanMs;
+        }
+        double runMs = stages[3].meanMs;
+
+        json << (c ? "," : "") << "\n    {\n"
+             << "      \"name\": \"" << entry.name << "\",\n"
+             << "      \"text_bytes\": " << entry.text.size() << ",\n"
+             << "      \"phoneme_ids\": " << phonemeIds.size() << ",\n"
+             << "      \"audio_seconds\": " << audioSeconds << ",\n"
+             << "      \"run_rtf\": " << (audioSeconds > 0 ? runMs / 1000.0 / audioSeconds : 0) << ",\n"
+             << "      \"total_rtf\": " << (audioSeconds > 0 ? totalMs / 1000.0 / audioSeconds : 0) << ",\n"
+             << "      \"stages\": [";
+        for (size_t s = 0; s < stages.size(); s++) {
+            const StageStats &stage = stages[s];
+            json << (s ? "," : "") << "\n        {\"name\": \"" << stage.name << "\""
+                 << ", \"mean_ms\": " << stage.meanMs
+                 << ", \"p50_ms\": " << stage.p50Ms
+                 << ", \"p99_ms\": " << stage.p99Ms
+                 << ", \"allocations\": " << stage.allocationsPerCall
+                 << ", \"allocated_bytes\": " << stage.allocatedBytesPerCall << "}";
+        }
+        json << "\n      ]\n    }";
+    }
+    json << "\n  ]\n}\n";
+
+    std::cout.rdbuf(stdoutBuffer);
+    std::remove(wavPath.c_str());
+
+    if (outputPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(outputPath);
+        file << json.str();
+    }
+    return 0;
+}
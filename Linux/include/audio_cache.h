@@ -0,0 +1,118 @@
+#ifndef AUDIO_CACHE_H_
+#define AUDIO_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vits_onnx.h"
+
+struct AudioCacheConfig {
+  // Directory holding one <key>.pcm file per cached utterance
+  std::string directory = "audio-cache";
+
+  // Least recently used entries are deleted beyond this size
+  uint64_t maxBytes = 1ull << 30;
+
+  bool enabled = true;
+};
+
+struct AudioCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  uint64_t bytes = 0;
+};
+
+// Read-only view of a cached utterance, backed by an mmap of its cache file.
+// The mapping stays valid even if the entry is evicted meanwhile.
+class MappedAudio
+{
+public:
+    // Wraps audio that could not be cached, so callers get one type either way
+    static std::shared_ptr<const MappedAudio> fromBuffer(std::vector<int16_t> audioBuffer,
+                                                         int sampleRate);
+
+    MappedAudio(const MappedAudio &) = delete;
+    MappedAudio &operator=(const MappedAudio &) = delete;
+    ~MappedAudio();
+
+    const int16_t *samples() const { return m_samples; }
+    size_t numSamples() const { return m_numSamples; }
+    int sampleRate() const { return m_sampleRate; }
+
+private:
+    friend class AudioCache;
+    MappedAudio() = default;
+
+    void *m_mapping = nullptr;
+    size_t m_mappingLength = 0;
+    const int16_t *m_samples = nullptr;
+    size_t m_numSamples = 0;
+    int m_sampleRate = 0;
+    std::vector<int16_t> m_owned;
+};
+
+// Persistent, content-addressed cache of final int16 PCM.
+//
+// Entries are keyed by a hash of everything that determines the audio: phoneme
+// ids, scales, speaker id, gain, pauses, where clauses are split and a hash of
+// the model file. Note that with a non-zero noiseScale the cache pins one
+// sample of the stochastic output.
+class AudioCache
+{
+public:
+    explicit AudioCache(AudioCacheConfig config = {});
+    AudioCache(const AudioCache &) = delete;
+    AudioCache &operator=(const AudioCache &) = delete;
+
+    bool enabled() const { return m_config.enabled; }
+
+    // FNV-1a over the file contents, for use as the modelHash of makeKey
+    static uint64_t hashFile(const std::string &path);
+
+    // maxIds is the maxIdsPerRun the audio is synthesized with, since long
+    // clauses are cut differently under a different MemoryBudget
+    static uint64_t makeKey(const std::vector<int64_t> &phonemeIds,
+                            const SynthesisConfig &synthesisConfig,
+                            uint64_t modelHash, size_t maxIds = SIZE_MAX);
+
+    // nullptr on a miss (or when disabled)
+    std::shared_ptr<const MappedAudio> lookup(uint64_t key);
+    void store(uint64_t key, const int16_t *samples, size_t numSamples,
+               int sampleRate);
+
+    AudioCacheStats stats() const;
+
+private:
+    struct Entry {
+        std::list<uint64_t>::iterator lruPosition;
+        uint64_t bytes;
+    };
+
+    std::string pathFor(uint64_t key) const;
+    void scanDirectory();
+    void removeLocked(uint64_t key);
+
+    // Removes least recently used entries until incomingBytes more fit
+    void evictLocked(uint64_t incomingBytes);
+
+    AudioCacheConfig m_config;
+
+    mutable std::mutex m_mutex;
+    std::list<uint64_t> m_lru; // most recently used first
+    std::unordered_map<uint64_t, Entry> m_entries;
+    uint64_t m_bytes = 0;
+    uint64_t m_evictions = 0;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+};
+
+#endif // AUDIO_CACHE_H_
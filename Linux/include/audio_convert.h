@@ -0,0 +1,56 @@
+#ifndef AUDIO_CONVERT_H_
+#define AUDIO_CONVERT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// How float model output is scaled to int16
+enum class GainMode {
+  // Normalize each output to its own peak (needs the whole buffer, so a
+  // peak pass precedes the scaling pass)
+  Peak,
+
+  // Multiply by a constant, so chunks convert independently in one pass
+  Fixed,
+
+  // Normalize to the highest peak seen so far, updated every few thousand
+  // samples; one pass except over blocks that raise the peak
+  Running,
+};
+
+// Largest |audio[i]|
+float findPeak(const float *audio, size_t count);
+
+// The GainMode::Fixed gain that normalizes audio with this peak the way
+// GainMode::Peak does, for a peak taken over several buffers
+float peakGain(float peak);
+
+// Writes clamp(audio[i] * gain) to out as int16 (truncating like the scalar
+// static_cast) and returns the peak of the input, found in the same pass.
+float scaleToInt16(const float *audio, size_t count, float gain, int16_t *out);
+
+// Widens IEEE half precision (fp16 model output) to float
+void halfToFloat(const uint16_t *half, size_t count, float *out);
+
+// Kernel picked at runtime for this CPU: "avx2", "sse2" or "scalar"
+const char *audioKernelName();
+
+// Converts model output to int16, one call per chunk. Keeps the running peak
+// between calls in GainMode::Running.
+class AudioConverter
+{
+public:
+    // fixedGain is relative to full scale: 1.0 maps 1.0f to 32767
+    explicit AudioConverter(GainMode mode = GainMode::Peak, float fixedGain = 1.0f)
+        : m_mode(mode), m_fixedGain(fixedGain) {}
+
+    void convert(const float *audio, size_t count, int16_t *out);
+    void reset() { m_runningPeak = 0; }
+
+private:
+    GainMode m_mode;
+    float m_fixedGain;
+    float m_runningPeak = 0;
+};
+
+#endif // AUDIO_CONVERT_H_
@@ -0,0 +1,105 @@
+#ifndef AUDIO_SINK_H_
+#define AUDIO_SINK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+// Destination for 16-bit PCM that is written chunk by chunk as it is
+// synthesized, so long outputs never have to be held in memory.
+// write() and close() throw std::runtime_error on I/O errors.
+class AudioSink
+{
+public:
+    virtual ~AudioSink() = default;
+
+    virtual void write(const int16_t *samples, size_t numSamples) = 0;
+
+    // Finalizes the output (e.g. patches header sizes). Safe to call more
+    // than once; destructors call it too but swallow errors.
+    virtual void close() = 0;
+
+    uint64_t samplesWritten() const { return m_samplesWritten; }
+
+protected:
+    uint64_t m_samplesWritten = 0;
+};
+
+// WAV file whose header is written with zero sizes up front and patched
+// with the real RIFF/data sizes on close(). Needs a seekable file.
+class WavFileSink : public AudioSink
+{
+public:
+    WavFileSink(const std::string &path, int sampleRate, int channels = 1);
+    ~WavFileSink() override;
+
+    void write(const int16_t *samples, size_t numSamples) override;
+    void close() override;
+
+    // Patches the header for what has been written so far, so the file is
+    // playable even if the process dies before close()
+    void flush();
+
+private:
+    std::ofstream m_file;
+    std::string m_path;
+    int m_sampleRate;
+    int m_channels;
+};
+
+// Headerless samples to a file descriptor: a pipe, a socket or stdout.
+// Fails with an error instead of SIGPIPE when the reader goes away if
+// SIGPIPE is ignored.
+class PcmSink : public AudioSink
+{
+public:
+    // Does not take ownership of fd
+    explicit PcmSink(int fd);
+    explicit PcmSink(const std::string &path);
+    ~PcmSink() override;
+
+    void write(const int16_t *samples, size_t numSamples) override;
+    void close() override;
+
+private:
+    int m_fd;
+    bool m_ownsFd;
+};
+
+// WAV file written through a shared mapping that is preallocated for
+// capacitySamples and doubled when that runs out; close() writes the
+// header and truncates the file to the real length. Avoids a write(2) per
+// chunk for many small chunks.
+class MappedWavSink : public AudioSink
+{
+public:
+    MappedWavSink(const std::string &path, int sampleRate, size_t capacitySamples,
+                  int channels = 1);
+    ~MappedWavSink() override;
+
+    void write(const int16_t *samples, size_t numSamples) override;
+    void close() override;
+
+private:
+    void map(size_t capacitySamples);
+
+    int m_fd = -1;
+    char *m_data = nullptr;
+    size_t m_mappedBytes = 0;
+    size_t m_capacitySamples = 0;
+    std::string m_path;
+    int m_sampleRate;
+    int m_channels;
+};
+
+// True for the *.pcm and *.raw paths that openAudioSink writes headerless
+bool isRawPcmPath(const std::string &path);
+
+// Picks a sink from the output path: "-" is raw PCM on stdout, *.pcm and
+// *.raw are raw PCM files and anything else is a streamed WAV file.
+std::unique_ptr<AudioSink> openAudioSink(const std::string &path, int sampleRate,
+                                         int channels = 1);
+
+#endif // AUDIO_SINK_H_
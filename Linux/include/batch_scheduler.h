@@ -0,0 +1,70 @@
+#ifndef BATCH_SCHEDULER_H_
+#define BATCH_SCHEDULER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vits_onnx.h"
+
+struct BatchSchedulerConfig {
+  // Most requests merged into one Session::Run
+  size_t maxBatchSize = 8;
+
+  // Longest time the oldest pending request waits for the batch to fill up
+  std::chrono::microseconds maxWait{5000};
+};
+
+struct BatchedAudio {
+  std::vector<int16_t> audio;
+  SynthesisResult result;
+
+  // Number of requests that shared the Session::Run
+  size_t batchSize = 0;
+};
+
+// Collects synthesis requests from any number of threads and runs them on one
+// background thread as padded [B, T_max] batches.
+//
+// Batching needs the graph to export "output_lengths"; without it the
+// scheduler still works but runs one request at a time.
+class BatchScheduler
+{
+public:
+    BatchScheduler(ModelSession &session, BatchSchedulerConfig config = {});
+    BatchScheduler(const BatchScheduler &) = delete;
+    BatchScheduler &operator=(const BatchScheduler &) = delete;
+    ~BatchScheduler();
+
+    std::future<BatchedAudio> submit(std::vector<int64_t> phonemeIds,
+                                     const SynthesisConfig &synthesisConfig);
+
+    size_t maxBatchSize() const { return m_config.maxBatchSize; }
+
+private:
+    struct Request {
+        std::vector<int64_t> phonemeIds;
+        SynthesisConfig synthesisConfig;
+        std::promise<BatchedAudio> promise;
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+
+    void run();
+    std::vector<Request> takeBatch();
+    void runBatch(std::vector<Request> &batch);
+
+    ModelSession &m_session;
+    BatchSchedulerConfig m_config;
+
+    std::mutex m_mutex;
+    std::condition_variable m_pending;
+    std::deque<Request> m_queue;
+    bool m_stopping = false;
+    std::thread m_worker;
+};
+
+#endif // BATCH_SCHEDULER_H_
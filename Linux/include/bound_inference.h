@@ -0,0 +1,84 @@
+#ifndef BOUND_INFERENCE_H_
+#define BOUND_INFERENCE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "vits_onnx.h"
+
+// What BoundInference allocates. The output can't be owned: its length
+// follows the durations the model predicts, and onnxruntime rejects a bound
+// output whose shape differs from the computed one, so it allocates the
+// output (from the heap unless the session's CPU arena is enabled; the
+// default tuning disables it) and its Ort::Value handles on every run.
+struct InferenceCounters {
+  uint64_t requests = 0;
+
+  // Times one of the owned buffers had to grow; flat in the steady state
+  uint64_t bufferGrowths = 0;
+  size_t bufferBytes = 0;
+
+  // malloc calls and bytes during Run() and output retrieval, onnxruntime's
+  // output and temporaries included. Process-wide (see processAllocations),
+  // so only attributable to this worker when it runs alone; stays 0 unless
+  // the binary links bench/malloc_counter.cpp.
+  uint64_t runAllocations = 0;
+  uint64_t runAllocationBytes = 0;
+};
+
+// Per-worker inference path built on Ort::IoBinding.
+//
+// Input tensors are views over buffers owned here, which only grow
+// (geometrically) when a request is longer than any before it. The output is
+// bound to CPU memory and converted from ORT's float buffer straight into an
+// owned int16 buffer, with no intermediate float copy. With the session's CPU
+// arena enabled ORT reuses its output block between runs as well. Inputs are
+// padded to the session's length buckets like in Synthesize.
+//
+// Not thread-safe: use one instance per worker thread.
+class BoundInference
+{
+public:
+    explicit BoundInference(ModelSession &session);
+    BoundInference(const BoundInference &) = delete;
+    BoundInference &operator=(const BoundInference &) = delete;
+
+    // Returns the number of samples written to audio(). Pass a converter to
+    // carry gain state across calls.
+    size_t run(const int64_t *phonemeIds, size_t numIds,
+               const SynthesisConfig &synthesisConfig, SynthesisResult &result,
+               AudioConverter *converter = nullptr);
+
+    // Valid until the next run()
+    const int16_t *audio() const { return m_audio.data(); }
+
+    // run() without the int16 conversion: returns the model's float audio,
+    // valid until the next run() or decode()
+    const float *decode(const int64_t *phonemeIds, size_t numIds,
+                        const SynthesisConfig &synthesisConfig, SynthesisResult &result,
+                        size_t &audioCount);
+
+    const InferenceCounters &counters() const { return m_counters; }
+
+private:
+    template <typename T> void ensureCapacity(std::vector<T> &buffer, size_t count);
+
+    ModelSession &m_session;
+    Ort::MemoryInfo m_memoryInfo;
+    Ort::IoBinding m_binding;
+
+    std::vector<int64_t> m_phonemeIds;
+    std::vector<int64_t> m_phonemeIdLengths;
+    std::vector<float> m_scales;
+    std::vector<int64_t> m_speakerId;
+    std::vector<int16_t> m_audio;
+    std::vector<float> m_halfScratch;
+    std::vector<Ort::Value> m_outputs;
+
+    InferenceCounters m_counters;
+
+    // output_lengths is bound to trim audio of padded inputs
+    bool m_bindOutputLengths = false;
+};
+
+#endif // BOUND_INFERENCE_H_
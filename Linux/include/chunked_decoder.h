@@ -0,0 +1,55 @@
+#ifndef CHUNKED_DECODER_H_
+#define CHUNKED_DECODER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vits_onnx.h"
+
+// Encoder and decoder graphs exported next to a single-graph model:
+// "vits2_model.onnx" -> "vits2_model.encoder.onnx", "vits2_model.decoder.onnx"
+std::string encoderModelPath(const std::string &modelPath);
+std::string decoderModelPath(const std::string &modelPath);
+bool hasSplitModel(const std::string &modelPath);
+
+// Streams VITS2 audio from a model exported as two graphs:
+//   encoder: input, input_lengths, scales[, sid] -> z [1, C, frames]
+//            (text encoder + duration predictor + flow)
+//   decoder: z [1, C, frames][, sid] -> output [1, 1, frames * hop]
+//
+// The encoder runs once per sequence; the decoder then runs on overlapping
+// latent windows, so audio comes out at a fixed chunk latency however long
+// the clause is.
+class ChunkedDecoder
+{
+public:
+    ChunkedDecoder(const std::string &encoderPath, const std::string &decoderPath,
+                   bool useCuda = false, ChunkedDecoderConfig config = {});
+    ChunkedDecoder(const ChunkedDecoder &) = delete;
+    ChunkedDecoder &operator=(const ChunkedDecoder &) = delete;
+
+    // Calls onAudio with each chunk's int16 audio (return false to stop).
+    // GainMode::Peak needs the whole waveform, so chunks fall back to
+    // GainMode::Running unless a converter is passed in.
+    void synthesize(const std::vector<int64_t> &phonemeIds,
+                    const SynthesisConfig &synthesisConfig,
+                    const AudioChunkCallback &onAudio, SynthesisResult &result,
+                    AudioConverter *converter = nullptr);
+
+    const ChunkedDecoderConfig &config() const { return m_config; }
+
+private:
+    // Runs the decoder on frames [start, end) of z and returns the audio
+    std::vector<float> decode(const std::vector<float> &z, int64_t channels,
+                              int64_t frames, int64_t start, int64_t end,
+                              const SynthesisConfig &synthesisConfig,
+                              double &inferSeconds);
+
+    ModelSession m_encoder;
+    ModelSession m_decoder;
+    bool m_decoderTakesSpeaker = false;
+    ChunkedDecoderConfig m_config;
+};
+
+#endif // CHUNKED_DECODER_H_
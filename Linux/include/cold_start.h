@@ -0,0 +1,81 @@
+#ifndef COLD_START_H_
+#define COLD_START_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+#include "session_tuning.h"
+
+struct ModelSession;
+
+struct ColdStartConfig {
+  // Save the optimized graph in ORT format on the first start and build
+  // later sessions from it, skipping graph optimization. Ignored with CUDA,
+  // whose optimized graphs are not portable.
+  bool cacheOptimizedModel = true;
+
+  // Empty means optimizedModelPath(modelPath, tuning)
+  std::string optimizedModelPath;
+
+  // Create the session from an mmap of the model file instead of a path
+  bool mapModel = true;
+
+  // Phoneme id sequence lengths synthesized once before the engine is ready,
+  // so the first real request doesn't pay for lazy initialization
+  std::vector<size_t> warmupLengths{16, 64, 256};
+};
+
+struct ColdStartStats {
+  // Session creation, including optimizing and saving on the first start
+  double sessionSeconds = 0;
+  double warmupSeconds = 0;
+
+  // From the start of loading until the engine is ready
+  double coldStartSeconds = 0;
+
+  bool optimizedModelSaved = false;
+  bool optimizedModelLoaded = false;
+
+  // File the session was built from
+  std::string modelFile;
+};
+
+// Read-only mmap of a whole model file
+class MappedModel
+{
+public:
+    explicit MappedModel(const std::string &path);
+    MappedModel(const MappedModel &) = delete;
+    MappedModel &operator=(const MappedModel &) = delete;
+    ~MappedModel();
+
+    const void *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    void *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// "<modelPath>.<optimization level>.ort"
+std::string optimizedModelPath(const std::string &modelPath,
+                               const SessionTuning &tuning);
+
+// Like createSession, but through the optimized model cache and mmap
+// described by config. Call configureSession first.
+void createSessionCached(const std::string &modelPath, ModelSession &session,
+                         Ort::Env &env, bool useCuda,
+                         const ColdStartConfig &config, ColdStartStats &stats);
+
+// Like loadModel, but with createSessionCached
+void loadModelCached(const std::string &modelPath, ModelSession &session,
+                     bool useCuda, const ColdStartConfig &config,
+                     ColdStartStats &stats);
+
+// Phoneme ids of an English phrase, repeated to the given length, for
+// warm-up runs
+std::vector<int64_t> warmupSequence(size_t length);
+
+#endif // COLD_START_H_
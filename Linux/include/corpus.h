@@ -0,0 +1,72 @@
+#ifndef CORPUS_H_
+#define CORPUS_H_
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vits_onnx.h"
+
+// One line of a corpus manifest
+struct CorpusItem {
+  std::string id;
+
+  // Exactly one of these is set; phoneme ids skip espeak-ng entirely
+  std::string text;
+  std::vector<int64_t> phonemeIds;
+
+  std::optional<SpeakerId> speakerId;
+
+  // Position in the manifest, counting items only
+  size_t index = 0;
+};
+
+// Reads a corpus manifest; throws std::runtime_error naming the line on
+// malformed input.
+//
+// JSONL (*.jsonl, *.json): one object per line with "id" and either "text"
+// or "phoneme_ids" (array of ints), optionally "speaker". Other keys are
+// ignored.
+//   {"id": "utt1", "text": "Hello there.", "speaker": 3}
+//   {"id": "utt2", "phoneme_ids": [20, 45, 57, 16, 4]}
+//
+// TSV (anything else): id, text and optional speaker columns. A first line
+// starting with "id\t" is a header naming the columns, where "phoneme_ids"
+// in place of "text" means space separated ids.
+//
+// Blank lines and lines starting with '#' are skipped. Ids must be unique
+// and may not contain tabs or line breaks, since the checkpoint stores them
+// one per line in a TSV.
+std::vector<CorpusItem> readCorpusManifest(const std::string &path);
+
+// Output path for an item from a pattern with {id}, {index} (zero padded to
+// 8 digits) and {speaker} placeholders, e.g. "{speaker}/{id}.wav". Throws
+// std::invalid_argument if the result would leave the output directory.
+std::string corpusOutputName(const std::string &pattern, const CorpusItem &item);
+
+// Progress of a corpus run, kept as append-only TSV files ("id\taudio_s")
+// in one directory so an interrupted run can resume. Every worker appends
+// to its own file; all files are read on resume, so the worker count may
+// change between runs.
+class CorpusCheckpoint
+{
+public:
+    CorpusCheckpoint(const std::string &directory, const std::string &workerName);
+    CorpusCheckpoint(const CorpusCheckpoint &) = delete;
+    CorpusCheckpoint &operator=(const CorpusCheckpoint &) = delete;
+
+    // Call once the item's output file is complete; flushed immediately
+    void markDone(const std::string &id, double audioSeconds);
+
+    // Audio seconds of every id finished by any worker of any run so far
+    static std::unordered_map<std::string, double> finishedItems(const std::string &directory);
+
+private:
+    std::ofstream m_file;
+    std::string m_path;
+};
+
+#endif // CORPUS_H_
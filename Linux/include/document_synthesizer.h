@@ -0,0 +1,73 @@
+#ifndef DOCUMENT_SYNTHESIZER_H_
+#define DOCUMENT_SYNTHESIZER_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vits_onnx.h"
+
+// Splits a document into sentences: after '.', '!' or '?' followed by white
+// space, and at blank lines. Whitespace-only sentences are dropped.
+std::vector<std::string> splitSentences(const std::string &document);
+
+struct DocumentConfig {
+  // Sentences buffered between two stages (phoneme ids or finished audio)
+  size_t queueDepth = 4;
+
+  SynthesisConfig synthesisConfig;
+  eSpeakPhonemeConfig eSpeakConfig;
+
+  // Phonemize on these helper processes instead of in-process under
+  // eSpeakMutex
+  std::shared_ptr<PhonemizerPool> phonemizerPool;
+};
+
+enum class DocumentStage { Phonemize, Infer, Output, Count };
+const char *documentStageName(DocumentStage stage);
+
+struct DocumentStageStats {
+  // Time spent working, excluding waits on the queues
+  double busySeconds = 0;
+
+  // busySeconds / wall time of the document; the stage closest to 1 limits
+  // throughput
+  double utilization = 0;
+  size_t items = 0;
+};
+
+struct DocumentStats {
+  double wallSeconds = 0;
+  double audioSeconds = 0;
+  size_t sentences = 0;
+  std::array<DocumentStageStats, (size_t)DocumentStage::Count> stages;
+
+  DocumentStageStats &stage(DocumentStage s) { return stages[(size_t)s]; }
+  const DocumentStageStats &stage(DocumentStage s) const { return stages[(size_t)s]; }
+};
+
+// Synthesizes long documents sentence by sentence with the stages
+// overlapped: one thread phonemizes, one runs the model and converts to
+// int16, and the calling thread hands audio to onAudio (e.g. to write it).
+// The stages are joined by bounded queues, so wall time approaches that of
+// the slowest stage, usually inference, and memory stays bounded.
+class DocumentSynthesizer
+{
+public:
+    // session must outlive this object and not be used elsewhere meanwhile
+    DocumentSynthesizer(ModelSession &session, DocumentConfig config = {});
+    DocumentSynthesizer(const DocumentSynthesizer &) = delete;
+    DocumentSynthesizer &operator=(const DocumentSynthesizer &) = delete;
+
+    // onAudio gets each sentence's audio in document order; returning false
+    // stops the pipeline. Exceptions from any stage are rethrown here.
+    DocumentStats synthesize(const std::string &document, const AudioChunkCallback &onAudio);
+
+private:
+    ModelSession &m_session;
+    DocumentConfig m_config;
+};
+
+#endif // DOCUMENT_SYNTHESIZER_H_
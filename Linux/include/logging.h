@@ -0,0 +1,38 @@
+#ifndef LOGGING_H_
+#define LOGGING_H_
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+enum class LogLevel { Error = 0, Warning = 1, Info = 2, Debug = 3 };
+
+// Starts at VITS_LOG_LEVEL (error, warning, info or debug), else Warning
+inline std::atomic<int> &logLevelStorage() {
+    static std::atomic<int> level([]() {
+        const char *value = std::getenv("VITS_LOG_LEVEL");
+        if (value == nullptr) {
+            return (int)LogLevel::Warning;
+        } else if (std::strcmp(value, "error") == 0) {
+            return (int)LogLevel::Error;
+        } else if (std::strcmp(value, "info") == 0) {
+            return (int)LogLevel::Info;
+        } else if (std::strcmp(value, "debug") == 0) {
+            return (int)LogLevel::Debug;
+        }
+        return (int)LogLevel::Warning;
+    }());
+    return level;
+}
+
+inline LogLevel logLevel() {
+    return (LogLevel)logLevelStorage().load(std::memory_order_relaxed);
+}
+
+inline void setLogLevel(LogLevel level) {
+    logLevelStorage().store((int)level, std::memory_order_relaxed);
+}
+
+inline bool logEnabled(LogLevel level) { return level <= logLevel(); }
+
+#endif // LOGGING_H_
@@ -0,0 +1,203 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct ColdStartStats;
+struct SynthesisResult;
+
+// Process-wide instrumentation of the synthesis hot path. Everything is a
+// relaxed atomic, so recording never takes a lock.
+
+class Counter
+{
+public:
+    void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+class Gauge
+{
+public:
+    void add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    void set(int64_t n) { m_value.store(n, std::memory_order_relaxed); }
+
+    int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> m_value{0};
+};
+
+// Latency histogram with fixed buckets doubling from 25us to ~200s
+class Histogram
+{
+public:
+    static constexpr size_t NUM_BUCKETS = 24;
+    static double bucketBound(size_t bucket) { return 25e-6 * (double)(1ull << bucket); }
+
+    void observe(double seconds);
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    double sumSeconds() const {
+        return (double)m_sumNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+    }
+
+    // Observations up to bucketBound(bucket); the last bucket also holds
+    // everything above the largest bound
+    uint64_t bucketCount(size_t bucket) const {
+        return m_buckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding the given quantile (0..1)
+    double quantile(double q) const;
+
+private:
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sumNanoseconds{0};
+};
+
+enum class Stage {
+  Phonemize,   // espeak-ng, per clause
+  Symbols,     // phoneme string -> ids
+  Run,         // Session::Run
+  Postprocess, // float -> int16
+  Output,      // handing audio to the caller (stream callbacks, sinks)
+  Count
+};
+
+const char *stageName(Stage stage);
+
+struct SynthesisMetrics {
+  std::array<Histogram, (size_t)Stage::Count> stages;
+
+  // One per synthesized clause, or piece of a clause split for the
+  // MemoryBudget: utterances are synthesized clause by clause (see
+  // splitIdClauses). Batch items count separately. audioMicroseconds is
+  // the decoded audio, without inserted pauses.
+  Counter clauses;
+  Counter audioMicroseconds;
+  Counter inferMicroseconds;
+
+  Counter phonemeCacheHits;
+  Counter phonemeCacheMisses;
+  Counter audioCacheHits;
+  Counter audioCacheMisses;
+
+  // Requests waiting in a BatchScheduler queue or for a SessionPool worker
+  Gauge queueDepth;
+
+  // Streamed responses cut off because synthesis failed after their 200
+  // header had been sent
+  Counter streamErrors;
+
+  // Phases of the most recent cold start (see ColdStartStats): session
+  // creation, which includes graph optimization unless it was built from
+  // the optimized model cache, then warm-up, and the total until ready
+  Gauge coldStartSessionMicroseconds;
+  Gauge coldStartWarmupMicroseconds;
+  Gauge coldStartTotalMicroseconds;
+
+  // Sessions built from the optimized model cache, and sessions that had
+  // to optimize the graph (and save it) because the cache was missing or
+  // stale
+  Counter optimizedModelCacheHits;
+  Counter optimizedModelCacheMisses;
+
+  Histogram &stage(Stage s) { return stages[(size_t)s]; }
+
+  // Counts one synthesized clause
+  void recordClause(const SynthesisResult &result);
+
+  // Sets the cold start gauges once an engine or pool is ready
+  void recordColdStart(const ColdStartStats &stats);
+};
+
+SynthesisMetrics &metrics();
+
+// Observes the time from construction to destruction into a stage
+class StageTimer
+{
+public:
+    explicit StageTimer(Stage stage)
+        : m_stage(stage), m_startTime(std::chrono::steady_clock::now()) {}
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+    ~StageTimer() {
+        auto endTime = std::chrono::steady_clock::now();
+        metrics().stage(m_stage).observe(
+            std::chrono::duration<double>(endTime - m_startTime).count());
+    }
+
+private:
+    Stage m_stage;
+    std::chrono::steady_clock::time_point m_startTime;
+};
+
+// Resident set size of this process, now and at its peak (0 if unknown)
+uint64_t residentMemoryBytes();
+uint64_t peakResidentMemoryBytes();
+
+// Lowers the peak to the current resident set so peakResidentMemoryBytes()
+// covers only what follows. Returns false where /proc/self/clear_refs is
+// not writable; the peak then stays the lifetime one.
+bool resetPeakResidentMemory();
+
+// malloc calls and bytes of the whole process so far. Only counted when the
+// binary links bench/malloc_counter.cpp, which interposes malloc (glibc);
+// returns false otherwise.
+bool processAllocations(uint64_t &count, uint64_t &bytes);
+
+// Resident set peak from construction on, for tools and benches that run
+// one request at a time. The kernel keeps a single process-wide mark and
+// construction resets it, so never use this where requests run
+// concurrently: each reset lowers the mark the others are measuring.
+class PeakMemoryScope
+{
+public:
+    PeakMemoryScope() { resetPeakResidentMemory(); }
+    PeakMemoryScope(const PeakMemoryScope &) = delete;
+    PeakMemoryScope &operator=(const PeakMemoryScope &) = delete;
+
+    uint64_t peakBytes() const { return peakResidentMemoryBytes(); }
+};
+
+// Prometheus text exposition format (version 0.0.4)
+std::string exportPrometheus();
+
+// One JSON object with totals, rates and per-stage mean/p50/p99
+std::string exportJson();
+
+// Hands a JSON snapshot to sink every interval on a background thread
+class MetricsReporter
+{
+public:
+    MetricsReporter(std::function<void(const std::string &)> sink,
+                    std::chrono::milliseconds interval);
+    MetricsReporter(const MetricsReporter &) = delete;
+    MetricsReporter &operator=(const MetricsReporter &) = delete;
+    ~MetricsReporter();
+
+private:
+    void run();
+
+    std::function<void(const std::string &)> m_sink;
+    std::chrono::milliseconds m_interval;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+#endif // METRICS_H_
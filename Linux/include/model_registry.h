@@ -0,0 +1,138 @@
+#ifndef MODEL_REGISTRY_H_
+#define MODEL_REGISTRY_H_
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "vits_onnx.h"
+
+struct VoiceConfig {
+  std::string modelPath;
+
+  // espeak-ng voice used to phonemize text for this model
+  std::string espeakVoice = "en-us";
+
+  int sampleRate = 22050;
+
+  // Speaker used for multi-speaker models
+  std::optional<SpeakerId> speakerId;
+};
+
+struct ModelRegistryConfig {
+  // Loaded models are evicted least recently used first beyond this
+  uint64_t memoryBudgetBytes = 2ull << 30;
+
+  // Size of the global thread pools every session shares (0 = default)
+  int intraOpThreads = 0;
+  int interOpThreads = 0;
+
+  std::string espeakDataPath = "espeak-ng/share/espeak-ng-data/";
+  bool useCuda = false;
+
+  // Per-Run memory limit of every loaded model, unlike memoryBudgetBytes
+  // which bounds the loaded weights (see MemoryBudget)
+  MemoryBudget runMemoryBudget;
+
+  // Phonemize on these helper processes instead of in-process under
+  // eSpeakMutex. Create it before the registry, whose Env starts threads.
+  std::shared_ptr<PhonemizerPool> phonemizerPool;
+};
+
+struct ModelStats {
+  std::string name;
+  bool loaded = false;
+
+  // Approximate resident memory the load added: the process-wide growth
+  // across the load, which also picks up whatever inference on other voices
+  // allocated meanwhile (at least the model file size)
+  uint64_t memoryBytes = 0;
+  double loadSeconds = 0;
+
+  uint64_t loads = 0;
+
+  // Unloads to stay within the budget or by evict(); replacing the voice
+  // with add() doesn't count
+  uint64_t evictions = 0;
+  uint64_t requests = 0;
+};
+
+// A loaded voice. Holding the shared_ptr keeps it usable even if the
+// registry evicts it meanwhile.
+struct LoadedModel {
+  std::string name;
+  ModelSession session;
+  SynthesisConfig synthesisConfig;
+  eSpeakPhonemeConfig eSpeakConfig;
+};
+
+// Hosts many voices in one process: every session runs on one Ort::Env with
+// global intra/inter-op thread pools, models are loaded on first use and the
+// least recently used ones are unloaded when memoryBudgetBytes is exceeded.
+//
+// Sessions keep their own CPU arena (as configured by their SessionTuning)
+// so an evicted model actually returns its memory.
+class ModelRegistry
+{
+public:
+    explicit ModelRegistry(ModelRegistryConfig config = {});
+    ModelRegistry(const ModelRegistry &) = delete;
+    ModelRegistry &operator=(const ModelRegistry &) = delete;
+
+    // Registers a voice without loading it; replaces an existing voice of
+    // the same name (callers still holding the old model keep using it)
+    void add(const std::string &name, VoiceConfig voice);
+    bool contains(const std::string &name);
+
+    // Loads the voice on first use. Throws std::out_of_range for unknown names.
+    std::shared_ptr<LoadedModel> acquire(const std::string &name);
+
+    // Thread-safe: phonemizes with the voice's espeak-ng voice and synthesizes
+    // with its sample rate and speaker
+    void synthesize(const std::string &name, const std::string &text,
+                    std::vector<int16_t> &audioBuffer, SynthesisResult &result);
+
+    // Unloads a voice now; it is loaded again on the next acquire()
+    void evict(const std::string &name);
+
+    uint64_t memoryBytes();
+    std::vector<ModelStats> stats();
+
+private:
+    struct Entry {
+      VoiceConfig voice;
+      std::shared_ptr<LoadedModel> model;
+      ModelStats stats;
+      std::list<std::string>::iterator lruPosition;
+
+      // Bumped by add() when the voice is replaced, so a load that started
+      // from the old VoiceConfig isn't stored
+      uint64_t generation = 0;
+    };
+
+    std::shared_ptr<LoadedModel> load(const std::string &name, const VoiceConfig &voice,
+                                      ModelStats &loadStats);
+    void unloadLocked(Entry &entry, bool eviction);
+    void evictOverBudgetLocked(const std::string &keep);
+
+    ModelRegistryConfig m_config;
+    Ort::Env m_env;
+
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+
+    // Most recently used first; only loaded voices
+    std::list<std::string> m_lru;
+    uint64_t m_memoryBytes = 0;
+
+    // Loads run one at a time so their memory deltas don't overlap each
+    // other (inference on loaded voices still runs alongside)
+    std::mutex m_loadMutex;
+};
+
+#endif // MODEL_REGISTRY_H_
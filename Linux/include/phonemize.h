@@ -1,15 +1,20 @@
 #ifndef PHOEMIZE_H_
 #define PHOEMIZE_H_
 
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <cstring>
 #include <vector>
+#include <unordered_map>
 #include <iostream>
 #include <locale>
 #include <codecvt>
 
+#include "phoneme_cache.h"
+
 
 typedef char32_t Phoneme;
 typedef std::map<Phoneme, std::vector<Phoneme>> PhonemeMap;
@@ -31,10 +36,42 @@ struct eSpeakPhonemeConfig {
   std::shared_ptr<PhonemeMap> phonemeMap;
 };
 
+// Phonemes of one clause as produced by a single espeak_TextToPhonemes call.
+struct PhonemeClause {
+  std::string phonemes;
+
+  // Punctuation that ended the clause in the source text (0 if none)
+  Phoneme terminator = 0;
+  bool last = false;
+};
+
 // Phonemizes text using espeak-ng.
 // Returns phonemes for each sentence as a separate std::vector.
 //
 // Assumes espeak_Initialize has already been called.
 std::string phonemize_eSpeak(std::string text, eSpeakPhonemeConfig &config);
 std::vector<int64_t> text_to_sequence(const std::string& text, eSpeakPhonemeConfig &config);
+
+// Same as above, but repeated (voice, text) pairs are served from cache
+// without calling espeak-ng.
+std::vector<int64_t> text_to_sequence(const std::string& text, eSpeakPhonemeConfig &config,
+                                      PhonemeCache &cache);
+
+// Phonemizes text one clause at a time, handing each clause to onClause as
+// soon as espeak-ng produces it. Return false from onClause to stop early.
+//
+// Assumes espeak_Initialize has already been called.
+void phonemize_eSpeak_clauses(std::string text, eSpeakPhonemeConfig &config,
+                              const std::function<bool(PhonemeClause &)> &onClause);
+
+// Clause phonemes followed by their terminator (or a comma/period if espeak-ng
+// reported none), ready for phonemes_to_sequence.
+std::string clause_phonemes(const PhonemeClause &clause, const eSpeakPhonemeConfig &config);
+
+// espeak-ng keeps global state, so threads that phonemize concurrently must
+// hold this mutex around each phonemize call.
+std::mutex &eSpeakMutex();
+
+// Maps an IPA phoneme string to model symbol ids, dropping unknown symbols.
+std::vector<int64_t> phonemes_to_sequence(const std::string& phonemes);
 #endif // PHONEMIZE_H_
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef PHONEMIZER_POOL_H_
+#define PHONEMIZER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "phonemize.h"
+
+struct PhonemizerPoolConfig {
+  // Helper processes, each with its own espeak-ng instance
+  size_t numWorkers = 2;
+
+  std::string espeakDataPath = "espeak-ng/share/espeak-ng-data/";
+
+  // Size of each worker's request and response ring buffer. Larger messages
+  // are streamed through in pieces.
+  size_t ringBytes = 256 << 10;
+};
+
+// Runs espeak-ng G2P on forked helper processes so it scales past the one
+// thread that the process-global espeak-ng state allows.
+//
+// Every helper has a pair of single-producer/single-consumer ring buffers in
+// shared memory: text and eSpeakPhonemeConfig go in, phoneme ids come back.
+// A caller leases one helper for the round trip, preferring a helper whose
+// voice is already set. A helper that dies fails the calls it was serving
+// and is replaced on its next use.
+//
+// Construct the pool before starting threads (in particular before creating
+// onnxruntime sessions). The constructor forks a zygote process, and every
+// helper, including replacements, is forked from that zygote rather than
+// from a caller thread. A replacement therefore never inherits a lock that
+// another thread of the caller held at the time of the fork.
+// The phonemeMap of the config is not sent to the helpers.
+class PhonemizerPool
+{
+public:
+    explicit PhonemizerPool(PhonemizerPoolConfig config = {});
+    PhonemizerPool(const PhonemizerPool &) = delete;
+    PhonemizerPool &operator=(const PhonemizerPool &) = delete;
+    ~PhonemizerPool();
+
+    // Same ids as text_to_sequence(text, config). Thread-safe.
+    std::vector<int64_t> textToSequence(const std::string &text,
+                                        const eSpeakPhonemeConfig &config);
+
+    // Ids of every non-empty clause, as phonemes_to_sequence(clause_phonemes())
+    // in phonemize_eSpeak_clauses. Thread-safe.
+    std::vector<std::vector<int64_t>> clauseSequences(const std::string &text,
+                                                      const eSpeakPhonemeConfig &config);
+
+    size_t numWorkers() const { return m_workers.size(); }
+
+private:
+    struct Worker;
+
+    std::vector<std::vector<int64_t>> call(uint32_t kind, const std::string &text,
+                                           const eSpeakPhonemeConfig &config);
+    Worker *acquire(const std::string &voice);
+    void release(Worker *worker);
+    void spawn(Worker &worker);
+    void stop(Worker &worker);
+    [[noreturn]] void zygoteMain(int control);
+
+    PhonemizerPoolConfig m_config;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // Socket to the zygote: a worker index goes in, the new helper's pid
+    // (or -1) comes back
+    pid_t m_zygote = -1;
+    int m_zygoteControl = -1;
+    std::mutex m_spawnMutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::vector<Worker *> m_free;
+};
+
+#endif // PHONEMIZER_POOL_H_
@@ -0,0 +1,60 @@
+#ifndef RESAMPLER_H_
+#define RESAMPLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct ResamplerFilter;
+
+// Streaming polyphase resampler for int16 audio (e.g. 22050 Hz model output
+// to 8000, 16000 or 48000 Hz). The rate ratio is reduced to L/M and a
+// Kaiser-windowed sinc is split into L phases of equal length; the filter
+// bank for a rate pair is built once per process and shared.
+//
+// Input may arrive in chunks of any size: the filter history is carried
+// over, so the output is the same as resampling the concatenated input in
+// one go. The filter's delay is compensated, so output sample n lines up
+// with input time n / outputRate, and after flush() exactly
+// ceil(inputSamples * outputRate / inputRate) samples have been produced.
+class Resampler
+{
+public:
+    Resampler(int inputRate, int outputRate);
+
+    // Appends the output that this chunk completes to out
+    void process(const int16_t *samples, size_t numSamples, std::vector<int16_t> &out);
+
+    // Appends the remaining output after the last chunk; the resampler can
+    // then be reused for a new stream
+    void flush(std::vector<int16_t> &out);
+
+    void reset();
+
+    int inputRate() const { return m_inputRate; }
+    int outputRate() const { return m_outputRate; }
+
+    // True when the rates are equal and process() only copies
+    bool passthrough() const { return m_inputRate == m_outputRate; }
+
+private:
+    int m_inputRate;
+    int m_outputRate;
+    std::shared_ptr<const ResamplerFilter> m_filter;
+
+    // Recent input as float; m_history[0] is input sample m_historyStart
+    // (negative before the first taps have been filled)
+    std::vector<float> m_history;
+    int64_t m_historyStart = 0;
+    uint64_t m_inputSamples = 0;
+    uint64_t m_outputSamples = 0;
+};
+
+// Resamples a whole buffer in place (no-op when the rates are equal)
+void resampleAudio(std::vector<int16_t> &audio, int inputRate, int outputRate);
+
+// Kernel picked at runtime for this CPU: "avx2", "sse2" or "scalar"
+const char *resamplerKernelName();
+
+#endif // RESAMPLER_H_
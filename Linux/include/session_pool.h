@@ -0,0 +1,109 @@
+#ifndef SESSION_POOL_H_
+#define SESSION_POOL_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "bound_inference.h"
+#include "vits_onnx.h"
+
+enum class SessionPoolMode {
+  // One Ort::Session per worker, all on one Ort::Env with a shared allocator
+  SeparateSessions,
+
+  // One Ort::Session that every worker calls Run on concurrently
+  SharedSession,
+};
+
+struct SessionPoolConfig {
+  // Number of callers that can synthesize at the same time
+  size_t numWorkers = 2;
+  SessionPoolMode mode = SessionPoolMode::SeparateSessions;
+
+  // Intra-op threads per session (0 = onnxruntime default). In SharedSession
+  // mode all concurrent Run calls share this one thread pool.
+  int intraOpThreads = 1;
+
+  // Give every worker a BoundInference and use it in synthesize()
+  bool useIoBinding = false;
+
+  bool useCuda = false;
+
+  // Per-Run memory limit of every session (see MemoryBudget)
+  MemoryBudget memoryBudget;
+
+  // Load through the optimized model cache and mmap, and warm up every
+  // worker before the constructor returns
+  std::optional<ColdStartConfig> coldStart;
+};
+
+// Serves up to numWorkers concurrent synthesis calls on sessions loaded once.
+class SessionPool
+{
+    // One worker slot: a session (possibly shared) and its own IoBinding state
+    struct Worker {
+        ModelSession *session;
+        std::unique_ptr<BoundInference> bound;
+    };
+
+public:
+    SessionPool(const std::string &modelPath, SessionPoolConfig config = {});
+    SessionPool(const SessionPool &) = delete;
+    SessionPool &operator=(const SessionPool &) = delete;
+
+    // Exclusive use of one worker slot; returned to the pool on destruction.
+    class Lease
+    {
+    public:
+        Lease(Lease &&other) noexcept;
+        Lease(const Lease &) = delete;
+        ~Lease();
+
+        ModelSession &session() { return *m_worker->session; }
+
+        // Preallocated IoBinding state owned by this worker slot
+        BoundInference &boundInference() { return *m_worker->bound; }
+
+    private:
+        friend class SessionPool;
+        Lease(SessionPool *pool, Worker *worker)
+            : m_pool(pool), m_worker(worker) {}
+
+        SessionPool *m_pool;
+        Worker *m_worker;
+    };
+
+    // Blocks until a worker slot is free
+    Lease acquire();
+
+    // Thread-safe: runs Synthesize on whichever worker slot is free
+    void synthesize(std::vector<int64_t> &phonemeIds,
+                    SynthesisConfig &synthesisConfig,
+                    std::vector<int16_t> &audioBuffer, SynthesisResult &result);
+
+    size_t numWorkers() const { return m_config.numWorkers; }
+
+    // Stats of the first session; only filled in with config.coldStart
+    const ColdStartStats &coldStartStats() const { return m_coldStartStats; }
+
+private:
+    void release(Worker *worker);
+    void warmUp(Worker &worker);
+
+    SessionPoolConfig m_config;
+    Ort::Env m_env;
+    Ort::MemoryInfo m_memoryInfo;
+    std::vector<std::unique_ptr<ModelSession>> m_sessions;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    ColdStartStats m_coldStartStats;
+
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::vector<Worker *> m_free;
+};
+
+#endif // SESSION_POOL_H_
@@ -0,0 +1,81 @@
+#ifndef SESSION_TUNING_H_
+#define SESSION_TUNING_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+// onnxruntime session settings that configureSession applies.
+// The defaults are the hand-picked settings loadModel always used; the
+// vits_autotune tool measures the alternatives on the target machine.
+struct SessionTuning {
+  // Roughly doubles load time for no visible inference benefit
+  GraphOptimizationLevel graphOptimizationLevel = GraphOptimizationLevel::ORT_DISABLE_ALL;
+
+  // 0 keeps the onnxruntime default; 1 slows down performance by ~2x
+  int intraOpThreads = 0;
+  int interOpThreads = 0;
+
+  // ORT_PARALLEL slows down performance very slightly
+  ExecutionMode executionMode = ExecutionMode::ORT_SEQUENTIAL;
+
+  bool cpuMemArena = false;
+  bool memPattern = false;
+
+  // Ascending lengths the phoneme id input is zero-padded up to (input_lengths
+  // keeps the real length, so the audio is unchanged). With only a few input
+  // shapes, the arena and memory pattern can be reused across requests.
+  // Empty = no padding; longer inputs than the last bucket are not padded.
+  std::vector<int64_t> lengthBuckets;
+};
+
+// Buckets tried by autotuneSession
+const std::vector<int64_t> &defaultLengthBuckets();
+
+// Smallest bucket that fits length, or length itself
+int64_t bucketLength(const SessionTuning &tuning, int64_t length);
+
+// Reads key=value lines as written by saveSessionTuning. Returns false if the
+// file does not exist; throws on malformed content.
+bool loadSessionTuning(const std::string &path, SessionTuning &tuning);
+void saveSessionTuning(const std::string &path, const SessionTuning &tuning);
+
+// One line summary, e.g.
+// "opt=all intra=4 inter=0 mode=sequential arena=1 pattern=1 buckets=64,128"
+std::string describeSessionTuning(const SessionTuning &tuning);
+
+// Tuning file the engine picks up for a model: "<modelPath>.tuning"
+std::string defaultTuningPath(const std::string &modelPath);
+
+struct AutotuneMeasurement {
+  SessionTuning tuning;
+  double loadSeconds = 0;
+  double inferSeconds = 0;
+  double audioSeconds = 0;
+  double realTimeFactor = 0;
+};
+
+struct AutotuneOptions {
+  // Timed passes over the corpus per candidate, after one warm-up run
+  int repeats = 2;
+
+  // Largest intra-op thread count tried (0 = hardware concurrency)
+  int maxThreads = 0;
+
+  bool useCuda = false;
+};
+
+// Coordinate-descent sweep over optimization level, intra/inter-op threads,
+// execution mode, arena, memory pattern and length buckets. Each setting is
+// varied in turn, keeping the best real-time factor found so far; buckets
+// are also tried together with the arena and memory pattern, which they
+// depend on. Every measured candidate is appended to measurements; the
+// winner is returned.
+SessionTuning autotuneSession(const std::string &modelPath,
+                              const std::vector<std::vector<int64_t>> &corpus,
+                              const AutotuneOptions &options,
+                              std::vector<AutotuneMeasurement> &measurements);
+
+#endif // SESSION_TUNING_H_
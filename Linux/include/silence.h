@@ -0,0 +1,88 @@
+#ifndef SILENCE_H_
+#define SILENCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "vits_onnx.h"
+
+// One clause of a phoneme id sequence: ids [begin, end), ending with the
+// punctuation (or phonemeSilenceSeconds phoneme) that closed it, if any
+struct IdClause {
+  size_t begin = 0;
+  size_t end = 0;
+  Phoneme terminator = 0;
+};
+
+// Splits phoneme ids after every clause terminator (. , ? ! : ;) and every
+// phoneme listed in phonemeSilenceSeconds. The terminator id stays at the
+// end of its clause so the model still sees the prosody cue. Clauses longer
+// than maxIds (see maxIdsPerRun) are cut again at the last word boundary
+// that fits, or at maxIds inside a word that doesn't; those pieces end with
+// terminator ' ' or 0 and get no pause.
+std::vector<IdClause> splitIdClauses(const std::vector<int64_t> &phonemeIds,
+                                     const SynthesisConfig &synthesisConfig,
+                                     size_t maxIds = SIZE_MAX);
+
+// Zero samples to insert after a clause that ended with terminator
+size_t clauseSilenceSamples(Phoneme terminator, const SynthesisConfig &synthesisConfig);
+
+// The part of audio between leading and trailing near-silence, found with a
+// 10ms frame energy threshold (see SynthesisConfig::trimThresholdDb). One
+// quiet frame is kept on each side so onsets and decays aren't clipped.
+// All of audio when trimming is disabled; empty when it is all silence.
+struct AudioSpan {
+  size_t begin = 0;
+  size_t end = 0;
+
+  size_t size() const { return end - begin; }
+};
+AudioSpan trimSilence(const int16_t *audio, size_t count,
+                      const SynthesisConfig &synthesisConfig);
+
+// Appends the trimmed clause audio followed by its pause
+void appendClauseAudio(const int16_t *audio, size_t count, Phoneme terminator,
+                       const SynthesisConfig &synthesisConfig,
+                       std::vector<int16_t> &audioBuffer);
+
+// Synthesizes one clause and returns its int16 audio, which must stay
+// valid until the next call
+typedef std::function<const int16_t *(const int64_t *phonemeIds, size_t numIds,
+                                      size_t &numSamples, SynthesisResult &result)>
+    ClauseSynthesizer;
+
+// Runs synthesizeClause on each clause of phonemeIds (see splitIdClauses)
+// and appends its trimmed audio and pause to audioBuffer. Fewer samples are
+// decoded than when the model renders the pauses itself. result sums the
+// clauses; its audioSeconds include the pauses.
+void appendClauses(const std::vector<int64_t> &phonemeIds,
+                   const SynthesisConfig &synthesisConfig, size_t maxIds,
+                   const ClauseSynthesizer &synthesizeClause,
+                   std::vector<int16_t> &audioBuffer, SynthesisResult &result);
+
+// Runs the model on one clause and returns its float audio, which must stay
+// valid until the next call
+typedef std::function<const float *(const int64_t *phonemeIds, size_t numIds,
+                                    size_t &numSamples, SynthesisResult &result)>
+    ClauseDecoder;
+
+// appendClauses for a whole request, converting to int16 here so all of its
+// clauses share one gain. GainMode::Peak decodes every clause first and
+// scales them by the peak of the request, so loudness doesn't jump at clause
+// boundaries or where the memory budget cut a clause; that keeps the
+// request's float audio in memory until the end. Fixed and Running convert
+// each clause as it is decoded, with one converter for the request.
+void appendDecodedClauses(const std::vector<int64_t> &phonemeIds,
+                          const SynthesisConfig &synthesisConfig, size_t maxIds,
+                          const ClauseDecoder &decodeClause,
+                          std::vector<int16_t> &audioBuffer, SynthesisResult &result);
+
+// appendDecodedClauses with SynthesizeFloat on session, within
+// session.memoryBudget
+void SynthesizeClauses(std::vector<int64_t> &phonemeIds,
+                       SynthesisConfig &synthesisConfig, ModelSession &session,
+                       std::vector<int16_t> &audioBuffer, SynthesisResult &result);
+
+#endif // SILENCE_H_
@@ -0,0 +1,114 @@
+#ifndef SYNTHESIS_SERVER_H_
+#define SYNTHESIS_SERVER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "phonemizer_pool.h"
+#include "session_pool.h"
+#include "vits_onnx.h"
+
+struct SynthesisServerConfig {
+  std::string modelPath = "vits2_model.onnx";
+  std::string espeakDataPath = "espeak-ng/share/espeak-ng-data/";
+
+  // Listen on a Unix domain socket (empty = off). A stale socket file at
+  // the path is replaced; any other file makes start() fail.
+  std::string unixSocketPath;
+
+  // Listen on TCP (-1 = off, 0 = any free port, see tcpPort())
+  int tcpPort = -1;
+  std::string bindAddress = "127.0.0.1";
+
+  // Connections handled at once; pool.numWorkers is set to match
+  size_t numWorkers = 2;
+
+  // Accepted connections waiting for a worker; beyond this they get a 503
+  size_t maxPendingConnections = 64;
+
+  // Largest accepted request body (the text to synthesize)
+  size_t maxBodyBytes = 1 << 20;
+
+  SessionPoolConfig pool;
+
+  // Phonemize on this many forked helper processes (see PhonemizerPool)
+  // instead of in-process under eSpeakMutex (0)
+  size_t phonemizerWorkers = 0;
+
+  // Defaults for every request; query parameters override them
+  SynthesisConfig synthesisConfig;
+  eSpeakPhonemeConfig eSpeakConfig;
+};
+
+// Long-running HTTP/1.1 server for local clients.
+//
+//   POST /synthesize?format=wav|pcm&speaker=0&noise_scale=0.667
+//                    &length_scale=1&noise_w=0.8&voice=en-us&rate=16000
+//     Body is the UTF-8 text (or pass it as &text=...). Audio is streamed
+//     back with chunked transfer encoding, one chunk per clause as soon as it
+//     is synthesized. rate resamples to another output rate (default: the
+//     model's). format=pcm sends raw 16-bit little-endian mono samples
+//     (sample rate in X-Sample-Rate); the WAV header of format=wav has
+//     unknown sizes since the length isn't known up front. If synthesis
+//     fails once streaming has begun, the connection is closed without the
+//     terminating chunk and vits_stream_errors_total is incremented.
+//   GET /metrics  Prometheus text (see exportPrometheus)
+//   GET /health
+//
+// Every connection carries one request. The model stays resident in a
+// SessionPool and numWorkers threads serve the accepted connections.
+class SynthesisServer
+{
+public:
+    explicit SynthesisServer(SynthesisServerConfig config);
+    SynthesisServer(const SynthesisServer &) = delete;
+    SynthesisServer &operator=(const SynthesisServer &) = delete;
+    ~SynthesisServer();
+
+    // Binds the listeners and starts the accept and worker threads
+    void start();
+
+    // Stops accepting, finishes queued connections and joins all threads
+    void stop();
+
+    // Bound TCP port (useful with tcpPort = 0), or -1
+    int tcpPort() const { return m_tcpPort; }
+
+private:
+    struct Request {
+      std::string method;
+      std::string path;
+      std::map<std::string, std::string> query;
+      std::string body;
+    };
+
+    void acceptLoop();
+    void workerLoop();
+    void handleConnection(int fd);
+    bool readRequest(int fd, Request &request, std::string &error);
+    void handleSynthesize(int fd, const Request &request);
+
+    SynthesisServerConfig m_config;
+    std::unique_ptr<PhonemizerPool> m_phonemizers;
+    std::unique_ptr<SessionPool> m_pool;
+
+    std::vector<int> m_listeners;
+    int m_tcpPort = -1;
+    int m_wakePipe[2] = {-1, -1};
+    std::thread m_acceptThread;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_connectionsReady;
+    std::deque<int> m_connections;
+    bool m_stopping = false;
+    bool m_started = false;
+};
+
+#endif // SYNTHESIS_SERVER_H_
@@ -0,0 +1,332 @@
+#ifndef VITS_ONNX_H_
+#define VITS_ONNX_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+#include "audio_convert.h"
+#include "cold_start.h"
+#include "phonemize.h"
+#include "session_tuning.h"
+
+typedef int64_t SpeakerId;
+
+class AudioCache;
+class MappedAudio;
+class BoundInference;
+class ChunkedDecoder;
+class PhonemizerPool;
+
+const float MAX_WAV_VALUE = 32767.0f;
+
+// Memory one Session::Run may use. Decoder activations grow with the output
+// length, so clauses predicted to exceed maxBytes are split further at word
+// boundaries and run one after another (see splitIdClauses).
+struct MemoryBudget {
+  // 0 = unbounded
+  uint64_t maxBytes = 0;
+
+  // Linear estimate of the peak of a Run: padded ids * samplesPerId *
+  // lengthScale output samples at bytesPerSample each (decoder activations,
+  // float output and int16 copy). The defaults are rough figures for a
+  // 22.05 kHz model, not a measurement of any model: run vits_memory_bench
+  // on the model in use and set both from its "fit" line.
+  double samplesPerId = 1100.0;
+  double bytesPerSample = 600.0;
+};
+
+struct ModelSession {
+    // Backing buffer when the session was created from an mmapped model;
+    // declared first so it is released after onnx
+    std::shared_ptr<const MappedModel> mappedModel;
+
+    Ort::Session onnx;
+    Ort::AllocatorWithDefaultOptions allocator;
+    Ort::SessionOptions options;
+    Ort::Env env;
+
+    // Applied by configureSession
+    SessionTuning tuning;
+
+    // Whether the graph exports output_lengths. Set by inspectSessionOutputs
+    // whenever onnx is created, and only read afterwards, so sessions shared
+    // between threads need no locking.
+    bool outputLengths = false;
+
+    MemoryBudget memoryBudget;
+
+    // env stays empty when the session is created on a shared Ort::Env
+    ModelSession() : onnx(nullptr), env(nullptr){};
+};
+
+struct SynthesisResult {
+  double inferSeconds = 0;
+  double audioSeconds = 0;
+  double realTimeFactor = 0;
+
+  // Time from the start of a streaming request until its first audio chunk
+  double firstAudioSeconds = 0;
+
+  // Phoneme ids of the longest single Run, and what the session's
+  // MemoryBudget estimates that Run needs (see predictedRunBytes). Nothing
+  // measures what a request actually allocated: the kernel only keeps a
+  // process-wide resident peak, which concurrent requests share.
+  size_t longestRunIds = 0;
+  uint64_t predictedPeakBytes = 0;
+};
+
+// Receives the int16 PCM of one clause as soon as it has been synthesized.
+// Return false to skip the remaining clauses.
+typedef std::function<bool(const int16_t *samples, size_t numSamples)>
+    AudioChunkCallback;
+
+
+struct SynthesisConfig {
+  // VITS inference settings
+  float noiseScale = 0.667f;
+  float lengthScale = 1.0f;
+  float noiseW = 0.8f;
+
+  // Audio settings
+  int sampleRate = 22050;
+  int sampleWidth = 2; // 16-bit
+  int channels = 1;    // mono
+
+  // Rate of the audio handed to callers. 0 keeps the model's sampleRate;
+  // anything else is resampled after the int16 conversion (see Resampler).
+  int outputSampleRate = 0;
+
+  // Float to int16 scaling. fixedGain is relative to full scale and only
+  // used by GainMode::Fixed.
+  GainMode gainMode = GainMode::Peak;
+  float fixedGain = 1.0f;
+
+  // Speaker id from 0 to numSpeakers - 1
+  std::optional<SpeakerId> speakerId;
+
+  // Extra silence. Text is synthesized clause by clause and these pauses
+  // are inserted as zero samples instead of being decoded by the model:
+  // sentenceSilenceSeconds after '.', '?' and '!', and
+  // phonemeSilenceSeconds[p] after phoneme p (which also splits there and
+  // overrides the sentence pause for its punctuation).
+  float sentenceSilenceSeconds = 0.2f;
+  std::optional<std::map<char32_t, float>> phonemeSilenceSeconds;
+
+  // Leading and trailing audio of each clause whose 10ms RMS stays below
+  // trimThresholdDb (relative to int16 full scale) is dropped before the
+  // pause is added
+  bool trimSilence = true;
+  float trimThresholdDb = -40.0f;
+
+  int outputRate() const { return outputSampleRate > 0 ? outputSampleRate : sampleRate; }
+};
+
+// Chunking of split encoder/decoder models (see ChunkedDecoder)
+struct ChunkedDecoderConfig {
+  // Latent frames emitted per chunk; with a 256 sample hop at 22050 Hz,
+  // 32 frames are ~370ms of audio
+  int64_t chunkFrames = 32;
+
+  // Extra frames decoded on both sides of a chunk so its edges see the same
+  // receptive field as a full decode
+  int64_t contextFrames = 8;
+
+  // Frames at each chunk boundary that are linearly cross-faded between the
+  // two decodes (at most contextFrames)
+  int64_t crossfadeFrames = 2;
+};
+
+// Reduced-precision exports of the same voice. Their inputs must keep the
+// float/int64 types of the fp32 graph (e.g. converted with keep_io_types);
+// the audio output may be float or float16.
+enum class ModelPrecision { Float32, Float16, Int8 };
+const char *precisionName(ModelPrecision precision);
+
+// "vits2_model.onnx" + "fp16" -> "vits2_model.fp16.onnx"
+std::string siblingModelPath(const std::string &modelPath, const std::string &part);
+
+// Path of the given precision next to the fp32 model (modelPath itself for
+// Float32); "vits2_model.onnx" -> "vits2_model.int8.onnx"
+std::string modelVariantPath(const std::string &modelPath, ModelPrecision precision);
+
+// Precisions with a model file next to modelPath, Float32 first
+std::vector<ModelPrecision> findModelVariants(const std::string &modelPath);
+
+// Audio samples of a model output tensor as float. Float tensors are read in
+// place; float16 tensors are widened into scratch.
+const float *audioData(const Ort::Value &tensor, std::vector<float> &scratch);
+
+void loadModel(std::string modelPath, ModelSession &session, bool useCuda);
+
+// The two halves of loadModel, for callers that own the Ort::Env:
+// configureSession fills session.options from session.tuning and
+// createSession builds session.onnx on the given env.
+void configureSession(ModelSession &session, bool useCuda);
+void createSession(const std::string &modelPath, ModelSession &session,
+                   Ort::Env &env);
+
+// Appends the synthesized int16 audio to audioBuffer. Pass a converter to
+// carry gain state across calls (e.g. GainMode::Running while streaming);
+// otherwise one is made from synthesisConfig for this call. phonemeIds are
+// padded to session.tuning.lengthBuckets.
+void Synthesize(std::vector<int64_t> &phonemeIds,
+                SynthesisConfig &synthesisConfig, ModelSession &session,
+                std::vector<int16_t> &audioBuffer, SynthesisResult &result,
+                AudioConverter *converter = nullptr);
+
+// Synthesize without the int16 conversion: appends the model's float audio,
+// for callers that pick the gain after seeing several runs (see
+// appendDecodedClauses)
+void SynthesizeFloat(std::vector<int64_t> &phonemeIds,
+                     SynthesisConfig &synthesisConfig, ModelSession &session,
+                     std::vector<float> &audioBuffer, SynthesisResult &result);
+
+// Estimated peak bytes of one Run over numIds phoneme ids padded to the
+// session's length bucket, and the most ids a Run may take so that its
+// padded length stays within session.memoryBudget (SIZE_MAX when it is
+// unbounded). Both come from the MemoryBudget model, not from measuring.
+uint64_t predictedRunBytes(const ModelSession &session, size_t numIds,
+                           const SynthesisConfig &synthesisConfig);
+size_t maxIdsPerRun(const ModelSession &session, const SynthesisConfig &synthesisConfig);
+
+// Converts audio to int16 and appends it to audioBuffer
+void convertAudio(const float *audio, int64_t audioCount,
+                  std::vector<int16_t> &audioBuffer, AudioConverter &converter);
+
+// Requests can share one Session::Run only if the graph sees the same scales
+// tensor and the same set of inputs for all of them.
+inline bool canShareBatch(const SynthesisConfig &a, const SynthesisConfig &b) {
+  return a.noiseScale == b.noiseScale && a.lengthScale == b.lengthScale &&
+         a.noiseW == b.noiseW &&
+         a.speakerId.has_value() == b.speakerId.has_value();
+}
+
+// True if the graph exports per-item audio lengths ("output_lengths"), which
+// SynthesizeBatch needs to split a padded [B, 1, T] output back into items.
+inline bool hasOutputLengths(const ModelSession &session) { return session.outputLengths; }
+
+// Records the graph outputs of a newly created session.onnx for
+// hasOutputLengths; createSession calls it
+void inspectSessionOutputs(ModelSession &session);
+
+// Synthesizes several phoneme id sequences in one Session::Run.
+// Sequences are zero-padded into a [B, T_max] input with their real lengths in
+// input_lengths. Batches larger than one require hasOutputLengths(session).
+void SynthesizeBatch(const std::vector<std::vector<int64_t>> &batchPhonemeIds,
+                     const std::vector<SynthesisConfig> &batchConfigs,
+                     ModelSession &session,
+                     std::vector<std::vector<int16_t>> &audioBuffers,
+                     std::vector<SynthesisResult> &results);
+
+// Initializes espeak-ng once per process.
+// Later calls are no-ops, so every engine can call it safely.
+void initializeESpeak(const std::string &espeakDataPath);
+
+// Long-lived synthesizer: the ONNX session and espeak-ng are loaded once in
+// the constructor and reused by every inference() call.
+class VitsONNX
+{
+public:
+    VitsONNX() = delete;
+    VitsONNX(const std::string &modelPath,
+             const std::string &espeakDataPath = "espeak-ng/share/espeak-ng-data/",
+             bool useCuda = false);
+
+    // Fast cold start: loads through the optimized model cache and mmap and
+    // runs coldStart.warmupLengths before returning (see coldStartStats())
+    VitsONNX(const std::string &modelPath, const std::string &espeakDataPath,
+             bool useCuda, const ColdStartConfig &coldStart);
+    VitsONNX(const VitsONNX &) = delete;
+    VitsONNX &operator=(const VitsONNX &) = delete;
+    ~VitsONNX();
+
+    std::vector<int16_t> inference(const std::string &text);
+    std::vector<int16_t> inference(const std::string &text, SynthesisResult &result);
+
+    // Phonemizes the text (holding eSpeakMutex unless phonemizerPool is set),
+    // then synthesizes it clause by clause, passing each clause's audio to
+    // onAudio before the next clause is started. When split
+    // encoder/decoder graphs sit next to the model (see hasSplitModel), long
+    // clauses are further streamed in chunks of chunkedDecoderConfig.
+    void inferenceStream(const std::string &text, const AudioChunkCallback &onAudio,
+                         SynthesisResult &result);
+
+    // Like inference(), but served straight from the mmapped audioCache file
+    // on a hit (no copy). Requires audioCache to be set. The audio is always
+    // at the model's sampleRate; synthesisConfig.outputSampleRate is ignored.
+    std::shared_ptr<const MappedAudio> inferenceMapped(const std::string &text,
+                                                       SynthesisResult &result);
+
+    // Session settings in use; read from defaultTuningPath(modelPath) when
+    // that file exists
+    const SessionTuning &sessionTuning() const { return m_session.tuning; }
+
+    // Per-Run memory limit; long clauses are split to stay within it.
+    // inference() and inferenceStream() report the estimated peak of their
+    // longest Run in SynthesisResult::predictedPeakBytes.
+    MemoryBudget &memoryBudget() { return m_session.memoryBudget; }
+
+    // Time spent in the constructor (espeak-ng init + session creation)
+    double loadSeconds() const { return m_loadSeconds; }
+    const ColdStartStats &coldStartStats() const { return m_coldStartStats; }
+
+    // Synthesizes placeholder sequences of the given lengths through the
+    // current inference path and returns the time taken. Call again after
+    // enabling useIoBinding to warm up its buffers too.
+    double warmUp(const std::vector<size_t> &lengths);
+
+    SynthesisConfig synthesisConfig;
+    eSpeakPhonemeConfig eSpeakConfig;
+
+    // Optional text -> phoneme id cache used by inference(); may be shared
+    // between engines
+    std::shared_ptr<PhonemeCache> phonemeCache;
+
+    // Optional helper processes that phonemize instead of this process's
+    // espeak-ng; may be shared between engines. Without it, phonemization
+    // holds eSpeakMutex.
+    std::shared_ptr<PhonemizerPool> phonemizerPool;
+
+    // Optional on-disk cache of final audio, consulted by inference() and
+    // inferenceMapped()
+    std::shared_ptr<AudioCache> audioCache;
+
+    // Run through Ort::IoBinding with preallocated, reused buffers
+    // (see BoundInference)
+    bool useIoBinding = false;
+    const BoundInference *boundInference() const { return m_bound.get(); }
+
+    // Used by inferenceStream() when split graphs exist; read when they are
+    // first loaded
+    bool useChunkedDecoder = true;
+    ChunkedDecoderConfig chunkedDecoderConfig;
+
+private:
+    std::vector<int64_t> textToSequence(const std::string &text);
+    void synthesizeIds(std::vector<int64_t> &phonemeIds,
+                       std::vector<int16_t> &audioBuffer, SynthesisResult &result);
+    BoundInference &bound();
+    ChunkedDecoder *chunkedDecoder();
+    uint64_t modelHash();
+
+    ModelSession m_session;
+    std::unique_ptr<BoundInference> m_bound;
+    std::unique_ptr<ChunkedDecoder> m_chunked;
+    bool m_chunkedChecked = false;
+    bool m_useCuda = false;
+    double m_loadSeconds = 0;
+    ColdStartStats m_coldStartStats;
+
+    std::string m_modelPath;
+    std::once_flag m_modelHashOnce;
+    uint64_t m_modelHash = 0;
+};
+
+#endif // VITS_ONNX_H_
@@ -23,9 +23,9 @@ struct WavHeader {
   uint32_t dataSize;
 };
 
-// Write WAV file header only
-void writeWavHeader(int sampleRate, int sampleWidth, int channels,
-                    uint32_t numSamples, std::ostream &audioFile) {
+// Header for numSamples frames
+inline WavHeader makeWavHeader(int sampleRate, int sampleWidth, int channels,
+                               uint32_t numSamples) {
   WavHeader header;
   header.dataSize = numSamples * sampleWidth * channels;
   header.chunkSize = header.dataSize + sizeof(WavHeader) - 8;
@@ -33,6 +33,13 @@ void writeWavHeader(int sampleRate, int sampleWidth, int channels,
   header.numChannels = channels;
   header.bytesPerSec = sampleRate * sampleWidth * channels;
   header.blockAlign = sampleWidth * channels;
+  return header;
+} /* makeWavHeader */
+
+// Write WAV file header only
+inline void writeWavHeader(int sampleRate, int sampleWidth, int channels,
+                    uint32_t numSamples, std::ostream &audioFile) {
+  WavHeader header = makeWavHeader(sampleRate, sampleWidth, channels, numSamples);
   audioFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
 
 } /* writeWavHeader */
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "audio_cache.h"
+
+namespace fs = std::filesystem;
+
+// File layout: header followed directly by numSamples int16 samples
+struct AudioCacheHeader {
+  char magic[4] = {'V', 'A', 'C', '1'};
+  uint32_t sampleRate = 0;
+  uint64_t numSamples = 0;
+};
+
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+static const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+std::shared_ptr<const MappedAudio> MappedAudio::fromBuffer(std::vector<int16_t> audioBuffer,
+                                                           int sampleRate) {
+    std::shared_ptr<MappedAudio> audio(new MappedAudio());
+    audio->m_owned = std::move(audioBuffer);
+    audio->m_samples = audio->m_owned.data();
+    audio->m_numSamples = audio->m_owned.size();
+    audio->m_sampleRate = sampleRate;
+    return audio;
+}
+
+MappedAudio::~MappedAudio() {
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingLength);
+    }
+}
+
+AudioCache::AudioCache(AudioCacheConfig config) : m_config(config) {
+    if (!m_config.enabled) {
+        return;
+    }
+    fs::create_directories(m_config.directory);
+    scanDirectory();
+}
+
+uint64_t AudioCache::hashFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path + " for hashing");
+    }
+
+    uint64_t hash = FNV_OFFSET;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hash = fnv1a(hash, buffer.data(), (size_t)file.gcount());
+    }
+    return hash;
+}
+
+uint64_t AudioCache::makeKey(const std::vector<int64_t> &phonemeIds,
+                             const SynthesisConfig &synthesisConfig,
+                             uint64_t modelHash, size_t maxIds) {
+    uint64_t hash = fnv1a(FNV_OFFSET, &modelHash, sizeof(modelHash));
+    float scales[3] = {synthesisConfig.noiseScale, synthesisConfig.lengthScale,
+                       synthesisConfig.noiseW};
+    hash = fnv1a(hash, scales, sizeof(scales));
+    int64_t speakerId = synthesisConfig.speakerId.value_or(-1);
+    hash = fnv1a(hash, &speakerId, sizeof(speakerId));
+
+    // Gain is applied before caching; fixedGain only matters in Fixed mode
+    int32_t gainMode = (int32_t)synthesisConfig.gainMode;
+    hash = fnv1a(hash, &gainMode, sizeof(gainMode));
+    if (synthesisConfig.gainMode == GainMode::Fixed) {
+        hash = fnv1a(hash, &synthesisConfig.fixedGain, sizeof(synthesisConfig.fixedGain));
+    }
+
+    // Pauses and trimming are part of the cached audio
+    float silence[2] = {synthesisConfig.sentenceSilenceSeconds,
+                        synthesisConfig.trimSilence ? synthesisConfig.trimThresholdDb : 1.0f};
+    hash = fnv1a(hash, silence, sizeof(silence));
+    if (synthesisConfig.phonemeSilenceSeconds) {
+        for (const auto &phonemeSilence : *synthesisConfig.phonemeSilenceSeconds) {
+            hash = fnv1a(hash, &phonemeSilence.first, sizeof(phonemeSilence.first));
+            hash = fnv1a(hash, &phonemeSilence.second, sizeof(phonemeSilence.second));
+        }
+    }
+    uint64_t runIds = (uint64_t)maxIds;
+    hash = fnv1a(hash, &runIds, sizeof(runIds));
+    hash = fnv1a(hash, phonemeIds.data(), phonemeIds.size() * sizeof(int64_t));
+    return hash;
+}
+
+std::string AudioCache::pathFor(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.pcm", (unsigned long long)key);
+    return m_config.directory + "/" + name;
+}
+
+// True for a temporary file of store() ("<key>.pcm.tmp.<pid>.<thread>")
+// whose writing process no longer exists
+static bool isStaleTempFile(const std::string &name) {
+    if (name.size() <= 25 || name.compare(16, 9, ".pcm.tmp.") != 0) {
+        return false;
+    }
+    char *end = nullptr;
+    long pid = std::strtol(name.c_str() + 25, &end, 10);
+    return end != name.c_str() + 25 && *end == '.' && pid > 0 &&
+           kill((pid_t)pid, 0) != 0 && errno == ESRCH;
+}
+
+// Rebuilds the LRU order from file modification times, which lookup() bumps,
+// and trims the cache to maxBytes. Temporary files left by writers that
+// crashed are deleted; other files that aren't named like an entry are
+// ignored.
+void AudioCache::scanDirectory() {
+    std::vector<std::pair<fs::file_time_type, uint64_t>> found;
+    std::vector<fs::path> stale;
+    for (const fs::directory_entry &file : fs::directory_iterator(m_config.directory)) {
+        std::string name = file.path().filename().string();
+        if (!file.is_regular_file()) {
+            continue;
+        }
+        if (isStaleTempFile(name)) {
+            stale.push_back(file.path());
+            continue;
+        }
+        if (name.size() != 20 || file.path().extension() != ".pcm" ||
+            name.find_first_not_of("0123456789abcdefABCDEF") != 16) {
+            continue;
+        }
+        uint64_t key = std::stoull(name.substr(0, 16), nullptr, 16);
+        found.emplace_back(file.last_write_time(), key);
+        m_entries[key].bytes = file.file_size();
+        m_bytes += file.file_size();
+    }
+
+    std::error_code error;
+    for (const fs::path &path : stale) {
+        fs::remove(path, error);
+    }
+
+    std::sort(found.begin(), found.end(),
+              [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (const auto &file : found) {
+        m_lru.push_back(file.second);
+        m_entries[file.second].lruPosition = std::prev(m_lru.end());
+    }
+
+    // The directory may hold more than maxBytes, e.g. after the limit was
+    // lowered
+    evictLocked(0);
+}
+
+void AudioCache::evictLocked(uint64_t incomingBytes) {
+    while (!m_lru.empty() && m_bytes + incomingBytes > m_config.maxBytes) {
+        removeLocked(m_lru.back());
+        m_evictions++;
+    }
+}
+
+void AudioCache::removeLocked(uint64_t key) {
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return;
+    }
+    m_bytes -= it->second.bytes;
+    m_lru.erase(it->second.lruPosition);
+    m_entries.erase(it);
+    unlink(pathFor(key).c_str());
+}
+
+std::shared_ptr<const MappedAudio> AudioCache::lookup(uint64_t key) {
+    if (!m_config.enabled) {
+        return nullptr;
+    }
+
+    std::string path = pathFor(key);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            m_misses++;
+            return nullptr;
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lruPosition);
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) != 0 ||
+        (size_t)fileStat.st_size < sizeof(AudioCacheHeader)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        removeLocked(key);
+        m_misses++;
+        return nullptr;
+    }
+
+    size_t length = (size_t)fileStat.st_size;
+    void *mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // Record the use so the LRU order survives restarts
+    futimens(fd, nullptr);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        m_misses++;
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedAudio> audio(new MappedAudio());
+    audio->m_mapping = mapping;
+    audio->m_mappingLength = length;
+
+    AudioCacheHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+    if (std::memcmp(header.magic, AudioCacheHeader().magic, sizeof(header.magic)) != 0 ||
+        length != sizeof(header) + header.numSamples * sizeof(int16_t)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        removeLocked(key);
+        m_misses++;
+        return nullptr;
+    }
+
+    audio->m_samples = (const int16_t *)((const char *)mapping + sizeof(header));
+    audio->m_numSamples = header.numSamples;
+    audio->m_sampleRate = (int)header.sampleRate;
+    m_hits++;
+    return audio;
+}
+
+void AudioCache::store(uint64_t key, const int16_t *samples, size_t numSamples,
+                       int sampleRate) {
+    if (!m_config.enabled) {
+        return;
+    }
+
+    AudioCacheHeader header;
+    header.sampleRate = (uint32_t)sampleRate;
+    header.numSamples = numSamples;
+    uint64_t bytes = sizeof(header) + numSamples * sizeof(int16_t);
+    if (bytes > m_config.maxBytes) {
+        return;
+    }
+
+    // Write under a temporary name so readers never map a partial file
+    std::string path = pathFor(key);
+    std::string tempPath = path + ".tmp." + std::to_string(getpid()) + "." +
+                           std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        file.write((const char *)&header, sizeof(header));
+        file.write((const char *)samples, numSamples * sizeof(int16_t));
+        if (!file) {
+            unlink(tempPath.c_str());
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    removeLocked(key);
+    evictLocked(bytes);
+
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return;
+    }
+    m_lru.push_front(key);
+    m_entries[key] = Entry{m_lru.begin(), bytes};
+    m_bytes += bytes;
+}
+
+AudioCacheStats AudioCache::stats() const {
+    AudioCacheStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.evictions = m_evictions;
+    stats.entries = m_entries.size();
+    stats.bytes = m_bytes;
+    return stats;
+}
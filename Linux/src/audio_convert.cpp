@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "audio_convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VITS_X86 1
+#include <immintrin.h>
+#endif
+
+static const float INT16_MAX_F = 32767.0f;
+static const float INT16_MIN_F = -32768.0f;
+
+// Matches the previous conversion: peaks below this are treated as silence
+static const float MIN_PEAK = 0.01f;
+
+// Running gain is updated per block of this many samples (8 KB of float),
+// small enough to still be in L1 if the block has to be scaled again
+static const size_t RUNNING_BLOCK = 2048;
+
+typedef float (*PeakKernel)(const float *, size_t);
+typedef float (*ScaleKernel)(const float *, size_t, float, int16_t *);
+typedef void (*HalfKernel)(const uint16_t *, size_t, float *);
+
+static float findPeakScalar(const float *audio, size_t count) {
+    float peak = 0;
+    for (size_t i = 0; i < count; i++) {
+        peak = std::max(peak, std::fabs(audio[i]));
+    }
+    return peak;
+}
+
+static float scaleScalar(const float *audio, size_t count, float gain, int16_t *out) {
+    float peak = 0;
+    for (size_t i = 0; i < count; i++) {
+        peak = std::max(peak, std::fabs(audio[i]));
+        out[i] = static_cast<int16_t>(
+            std::clamp(audio[i] * gain, INT16_MIN_F, INT16_MAX_F));
+    }
+    return peak;
+}
+
+static void halfToFloatScalar(const uint16_t *half, size_t count, float *out) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t sign = (uint32_t)(half[i] & 0x8000) << 16;
+        uint32_t exponent = (half[i] >> 10) & 0x1F;
+        uint32_t mantissa = half[i] & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0x1F) {
+            // Inf / NaN
+            bits = sign | 0x7F800000 | (mantissa << 13);
+        } else if (exponent != 0) {
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        } else if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: renormalize the mantissa
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+        std::memcpy(&out[i], &bits, sizeof(bits));
+    }
+}
+
+#ifdef VITS_X86
+static float horizontalMax(__m128 v) {
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+static float findPeakSse2(const float *audio, size_t count) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 peak = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        peak = _mm_max_ps(peak, _mm_and_ps(_mm_loadu_ps(audio + i), absMask));
+    }
+    return std::max(horizontalMax(peak), findPeakScalar(audio + i, count - i));
+}
+
+static float scaleSse2(const float *audio, size_t count, float gain, int16_t *out) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 scale = _mm_set1_ps(gain);
+    const __m128 lower = _mm_set1_ps(INT16_MIN_F);
+    const __m128 upper = _mm_set1_ps(INT16_MAX_F);
+    __m128 peak = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_loadu_ps(audio + i);
+        __m128 b = _mm_loadu_ps(audio + i + 4);
+        peak = _mm_max_ps(peak, _mm_and_ps(a, absMask));
+        peak = _mm_max_ps(peak, _mm_and_ps(b, absMask));
+        a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(a, scale), lower), upper);
+        b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(b, scale), lower), upper);
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128((__m128i *)(out + i), packed);
+    }
+    return std::max(horizontalMax(peak), scaleScalar(audio + i, count - i, gain, out + i));
+}
+
+__attribute__((target("avx2")))
+static float findPeakAvx2(const float *audio, size_t count) {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 peak = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        peak = _mm256_max_ps(peak, _mm256_and_ps(_mm256_loadu_ps(audio + i), absMask));
+    }
+    __m128 halves = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    return std::max(horizontalMax(halves), findPeakScalar(audio + i, count - i));
+}
+
+__attribute__((target("avx2")))
+static float scaleAvx2(const float *audio, size_t count, float gain, int16_t *out) {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 scale = _mm256_set1_ps(gain);
+    const __m256 lower = _mm256_set1_ps(INT16_MIN_F);
+    const __m256 upper = _mm256_set1_ps(INT16_MAX_F);
+    __m256 peak = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_loadu_ps(audio + i);
+        __m256 b = _mm256_loadu_ps(audio + i + 8);
+        peak = _mm256_max_ps(peak, _mm256_and_ps(a, absMask));
+        peak = _mm256_max_ps(peak, _mm256_and_ps(b, absMask));
+        a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(a, scale), lower), upper);
+        b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(b, scale), lower), upper);
+        // packs works per 128-bit lane, so restore sample order afterwards
+        __m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(out + i), packed);
+    }
+    __m128 halves = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    return std::max(horizontalMax(halves), scaleSse2(audio + i, count - i, gain, out + i));
+}
+
+__attribute__((target("avx2,f16c")))
+static void halfToFloatF16c(const uint16_t *half, size_t count, float *out) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(half + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+    halfToFloatScalar(half + i, count - i, out + i);
+}
+#endif // VITS_X86
+
+struct AudioKernels {
+    PeakKernel findPeak;
+    ScaleKernel scale;
+    HalfKernel halfToFloat;
+    const char *name;
+};
+
+static AudioKernels selectKernels() {
+#ifdef VITS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        HalfKernel half = __builtin_cpu_supports("f16c") ? halfToFloatF16c : halfToFloatScalar;
+        return {findPeakAvx2, scaleAvx2, half, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {findPeakSse2, scaleSse2, halfToFloatScalar, "sse2"};
+    }
+#endif
+    return {findPeakScalar, scaleScalar, halfToFloatScalar, "scalar"};
+}
+
+static const AudioKernels &kernels() {
+    static const AudioKernels selected = selectKernels();
+    return selected;
+}
+
+float findPeak(const float *audio, size_t count) {
+    return kernels().findPeak(audio, count);
+}
+
+float peakGain(float peak) {
+    return 1.0f / std::max(MIN_PEAK, peak);
+}
+
+float scaleToInt16(const float *audio, size_t count, float gain, int16_t *out) {
+    return kernels().scale(audio, count, gain, out);
+}
+
+void halfToFloat(const uint16_t *half, size_t count, float *out) {
+    kernels().halfToFloat(half, count, out);
+}
+
+const char *audioKernelName() {
+    return kernels().name;
+}
+
+void AudioConverter::convert(const float *audio, size_t count, int16_t *out) {
+    switch (m_mode) {
+    case GainMode::Fixed:
+        scaleToInt16(audio, count, m_fixedGain * INT16_MAX_F, out);
+        break;
+    case GainMode::Running:
+        // Scale with the gain so far and take the block's peak in the same
+        // pass; only a block that raises the peak is scaled again
+        for (size_t offset = 0; offset < count; offset += RUNNING_BLOCK) {
+            size_t blockCount = std::min(RUNNING_BLOCK, count - offset);
+            float gain = INT16_MAX_F / std::max(MIN_PEAK, m_runningPeak);
+            float peak = scaleToInt16(audio + offset, blockCount, gain, out + offset);
+            if (peak > m_runningPeak) {
+                m_runningPeak = peak;
+                float newGain = INT16_MAX_F / std::max(MIN_PEAK, m_runningPeak);
+                if (newGain != gain) {
+                    scaleToInt16(audio + offset, blockCount, newGain, out + offset);
+                }
+            }
+        }
+        break;
+    case GainMode::Peak:
+    default:
+        // The gain depends on the peak of the whole buffer, so it must be
+        // known before the first sample is scaled: two passes
+        scaleToInt16(audio, count, INT16_MAX_F / std::max(MIN_PEAK, findPeak(audio, count)), out);
+        break;
+    }
+}
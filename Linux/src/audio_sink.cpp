@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "audio_sink.h"
+#include "wavfile.hpp"
+
+// 16-bit PCM
+static const int SAMPLE_WIDTH = 2;
+
+// Frames for the header; sizes past 4 GiB can't be expressed, so stop there
+static uint32_t headerFrames(uint64_t numSamples, int channels) {
+    uint64_t maxFrames = (0xFFFFFFFFull - sizeof(WavHeader)) / (SAMPLE_WIDTH * channels);
+    return (uint32_t)std::min<uint64_t>(numSamples / channels, maxFrames);
+}
+
+static std::runtime_error ioError(const std::string &what, const std::string &path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+WavFileSink::WavFileSink(const std::string &path, int sampleRate, int channels)
+    : m_file(path, std::ios::binary | std::ios::trunc), m_path(path),
+      m_sampleRate(sampleRate), m_channels(channels) {
+    if (!m_file) {
+        throw ioError("Cannot open", path);
+    }
+    writeWavHeader(m_sampleRate, SAMPLE_WIDTH, m_channels, 0, m_file);
+}
+
+WavFileSink::~WavFileSink() {
+    try {
+        close();
+    } catch (const std::exception &) {
+    }
+}
+
+void WavFileSink::write(const int16_t *samples, size_t numSamples) {
+    if (!m_file.is_open()) {
+        throw std::runtime_error("Write to closed sink " + m_path);
+    }
+    m_file.write((const char *)samples, sizeof(int16_t) * numSamples);
+    if (!m_file) {
+        throw ioError("Failed to write", m_path);
+    }
+    m_samplesWritten += numSamples;
+}
+
+void WavFileSink::flush() {
+    if (!m_file.is_open()) {
+        return;
+    }
+    std::streampos end = m_file.tellp();
+    m_file.seekp(0);
+    writeWavHeader(m_sampleRate, SAMPLE_WIDTH, m_channels,
+                   headerFrames(m_samplesWritten, m_channels), m_file);
+    m_file.seekp(end);
+    m_file.flush();
+    if (!m_file) {
+        throw ioError("Failed to update header of", m_path);
+    }
+}
+
+void WavFileSink::close() {
+    if (!m_file.is_open()) {
+        return;
+    }
+    flush();
+    m_file.close();
+}
+
+PcmSink::PcmSink(int fd) : m_fd(fd), m_ownsFd(false) {}
+
+PcmSink::PcmSink(const std::string &path)
+    : m_fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+      m_ownsFd(true) {
+    if (m_fd < 0) {
+        throw ioError("Cannot open", path);
+    }
+}
+
+PcmSink::~PcmSink() {
+    try {
+        close();
+    } catch (const std::exception &) {
+    }
+}
+
+void PcmSink::write(const int16_t *samples, size_t numSamples) {
+    if (m_fd < 0) {
+        throw std::runtime_error("Write to closed PCM sink");
+    }
+    const char *data = (const char *)samples;
+    size_t remaining = sizeof(int16_t) * numSamples;
+    while (remaining > 0) {
+        ssize_t written = ::write(m_fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw ioError("Failed to write", "PCM output");
+        }
+        data += written;
+        remaining -= (size_t)written;
+    }
+    m_samplesWritten += numSamples;
+}
+
+void PcmSink::close() {
+    if (m_fd >= 0 && m_ownsFd) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+}
+
+MappedWavSink::MappedWavSink(const std::string &path, int sampleRate,
+                             size_t capacitySamples, int channels)
+    : m_path(path), m_sampleRate(sampleRate), m_channels(channels) {
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        throw ioError("Cannot open", path);
+    }
+    try {
+        map(std::max<size_t>(capacitySamples, 4096));
+    } catch (...) {
+        ::close(m_fd);
+        throw;
+    }
+}
+
+MappedWavSink::~MappedWavSink() {
+    try {
+        close();
+    } catch (const std::exception &) {
+    }
+}
+
+// The old mapping is only dropped once the new one exists, so a failed grow
+// leaves the sink able to finish what it already has
+void MappedWavSink::map(size_t capacitySamples) {
+    size_t bytes = sizeof(WavHeader) + sizeof(int16_t) * capacitySamples;
+    if (ftruncate(m_fd, (off_t)bytes) != 0) {
+        throw ioError("Failed to preallocate", m_path);
+    }
+    void *data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        throw ioError("Failed to map", m_path);
+    }
+    if (m_data) {
+        munmap(m_data, m_mappedBytes);
+    }
+    m_data = (char *)data;
+    m_mappedBytes = bytes;
+    m_capacitySamples = capacitySamples;
+}
+
+void MappedWavSink::write(const int16_t *samples, size_t numSamples) {
+    if (m_fd < 0) {
+        throw std::runtime_error("Write to closed sink " + m_path);
+    }
+    uint64_t needed = m_samplesWritten + numSamples;
+    if (needed > m_capacitySamples) {
+        map(std::max<size_t>(needed, 2 * m_capacitySamples));
+    }
+    std::memcpy(m_data + sizeof(WavHeader) + sizeof(int16_t) * m_samplesWritten, samples,
+                sizeof(int16_t) * numSamples);
+    m_samplesWritten = needed;
+}
+
+void MappedWavSink::close() {
+    if (m_fd < 0) {
+        return;
+    }
+    WavHeader header = makeWavHeader(m_sampleRate, SAMPLE_WIDTH, m_channels,
+                                     headerFrames(m_samplesWritten, m_channels));
+    if (m_data) {
+        std::memcpy(m_data, &header, sizeof(header));
+        munmap(m_data, m_mappedBytes);
+        m_data = nullptr;
+    }
+
+    // Drop the unused part of the preallocation
+    off_t length = (off_t)(sizeof(WavHeader) + sizeof(int16_t) * m_samplesWritten);
+    int result = ftruncate(m_fd, length);
+    ::close(m_fd);
+    m_fd = -1;
+    if (result != 0) {
+        throw ioError("Failed to truncate", m_path);
+    }
+}
+
+bool isRawPcmPath(const std::string &path) {
+    auto endsWith = [&path](const std::string &suffix) {
+        return path.size() >= suffix.size() &&
+               path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return endsWith(".pcm") || endsWith(".raw");
+}
+
+std::unique_ptr<AudioSink> openAudioSink(const std::string &path, int sampleRate,
+                                         int channels) {
+    if (path == "-") {
+        return std::make_unique<PcmSink>(STDOUT_FILENO);
+    }
+    if (isRawPcmPath(path)) {
+        return std::make_unique<PcmSink>(path);
+    }
+    return std::make_unique<WavFileSink>(path, sampleRate, channels);
+}
@@ -0,0 +1,119 @@
+#include <exception>
+#include <iostream>
+
+#include "batch_scheduler.h"
+#include "logging.h"
+#include "metrics.h"
+
+BatchScheduler::BatchScheduler(ModelSession &session, BatchSchedulerConfig config)
+    : m_session(session), m_config(config) {
+    if (m_config.maxBatchSize == 0) {
+        m_config.maxBatchSize = 1;
+    }
+    if (m_config.maxBatchSize > 1 && !hasOutputLengths(m_session)) {
+        if (logEnabled(LogLevel::Warning)) {
+            std::cerr << "Model has no output_lengths output, batching disabled" << std::endl;
+        }
+        m_config.maxBatchSize = 1;
+    }
+    m_worker = std::thread(&BatchScheduler::run, this);
+}
+
+BatchScheduler::~BatchScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_pending.notify_all();
+    m_worker.join();
+}
+
+std::future<BatchedAudio> BatchScheduler::submit(std::vector<int64_t> phonemeIds,
+                                                 const SynthesisConfig &synthesisConfig) {
+    Request request;
+    request.phonemeIds = std::move(phonemeIds);
+    request.synthesisConfig = synthesisConfig;
+    request.enqueueTime = std::chrono::steady_clock::now();
+    std::future<BatchedAudio> future = request.promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            throw std::runtime_error("BatchScheduler is shutting down");
+        }
+        m_queue.push_back(std::move(request));
+    }
+    metrics().queueDepth.add(1);
+    m_pending.notify_one();
+    return future;
+}
+
+void BatchScheduler::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_pending.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            // Stopping and fully drained
+            return;
+        }
+
+        // Give the batch until the oldest request's deadline to fill up
+        auto deadline = m_queue.front().enqueueTime + m_config.maxWait;
+        m_pending.wait_until(lock, deadline, [this]() {
+            return m_stopping || m_queue.size() >= m_config.maxBatchSize;
+        });
+
+        std::vector<Request> batch = takeBatch();
+        lock.unlock();
+        runBatch(batch);
+        lock.lock();
+    }
+}
+
+// Takes the oldest request plus every queued request that can share its scales,
+// up to maxBatchSize. Incompatible requests keep their place in the queue.
+// Called with m_mutex held.
+std::vector<BatchScheduler::Request> BatchScheduler::takeBatch() {
+    std::vector<Request> batch;
+    batch.push_back(std::move(m_queue.front()));
+    m_queue.pop_front();
+
+    for (auto it = m_queue.begin();
+         it != m_queue.end() && batch.size() < m_config.maxBatchSize;) {
+        if (canShareBatch(it->synthesisConfig, batch.front().synthesisConfig)) {
+            batch.push_back(std::move(*it));
+            it = m_queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    metrics().queueDepth.add(-(int64_t)batch.size());
+    return batch;
+}
+
+void BatchScheduler::runBatch(std::vector<Request> &batch) {
+    std::vector<std::vector<int64_t>> batchPhonemeIds;
+    std::vector<SynthesisConfig> batchConfigs;
+    for (Request &request : batch) {
+        batchPhonemeIds.push_back(std::move(request.phonemeIds));
+        batchConfigs.push_back(request.synthesisConfig);
+    }
+
+    std::vector<std::vector<int16_t>> audioBuffers;
+    std::vector<SynthesisResult> results;
+    try {
+        SynthesizeBatch(batchPhonemeIds, batchConfigs, m_session, audioBuffers, results);
+    } catch (...) {
+        for (Request &request : batch) {
+            request.promise.set_exception(std::current_exception());
+        }
+        return;
+    }
+
+    for (size_t b = 0; b < batch.size(); b++) {
+        BatchedAudio batched;
+        batched.audio = std::move(audioBuffers[b]);
+        batched.result = results[b];
+        batched.batchSize = batch.size();
+        batch[b].promise.set_value(std::move(batched));
+    }
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdexcept>
+
+#include "bound_inference.h"
+#include "metrics.h"
+
+BoundInference::BoundInference(ModelSession &session)
+    : m_session(session),
+      m_memoryInfo(Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator,
+                                              OrtMemType::OrtMemTypeDefault)),
+      m_binding(session.onnx) {
+    ensureCapacity(m_phonemeIdLengths, 1);
+    ensureCapacity(m_scales, 3);
+    ensureCapacity(m_speakerId, 1);
+    m_binding.BindOutput("output", m_memoryInfo);
+    if (!session.tuning.lengthBuckets.empty() && hasOutputLengths(session)) {
+        m_binding.BindOutput("output_lengths", m_memoryInfo);
+        m_bindOutputLengths = true;
+    }
+}
+
+template <typename T>
+void BoundInference::ensureCapacity(std::vector<T> &buffer, size_t count) {
+    if (buffer.size() >= count) {
+        return;
+    }
+    size_t newSize = std::max(count, 2 * buffer.size());
+    m_counters.bufferBytes += (newSize - buffer.size()) * sizeof(T);
+    buffer.resize(newSize);
+    m_counters.bufferGrowths++;
+}
+
+size_t BoundInference::run(const int64_t *phonemeIds, size_t numIds,
+                           const SynthesisConfig &synthesisConfig,
+                           SynthesisResult &result, AudioConverter *converter) {
+    size_t audioCount = 0;
+    const float *audio = decode(phonemeIds, numIds, synthesisConfig, result, audioCount);
+
+    ensureCapacity(m_audio, audioCount);
+    StageTimer timer(Stage::Postprocess);
+    if (converter) {
+        converter->convert(audio, audioCount, m_audio.data());
+    } else {
+        AudioConverter configConverter(synthesisConfig.gainMode, synthesisConfig.fixedGain);
+        configConverter.convert(audio, audioCount, m_audio.data());
+    }
+    return audioCount;
+}
+
+const float *BoundInference::decode(const int64_t *phonemeIds, size_t numIds,
+                                    const SynthesisConfig &synthesisConfig,
+                                    SynthesisResult &result, size_t &audioCount) {
+    m_counters.requests++;
+
+    // Zero-pad up to the length bucket; input_lengths keeps the real length
+    size_t paddedLength = (size_t)bucketLength(m_session.tuning, (int64_t)numIds);
+    ensureCapacity(m_phonemeIds, paddedLength);
+    std::copy(phonemeIds, phonemeIds + numIds, m_phonemeIds.begin());
+    std::fill(m_phonemeIds.begin() + numIds, m_phonemeIds.begin() + paddedLength, 0);
+    m_phonemeIdLengths[0] = (int64_t)numIds;
+    m_scales[0] = synthesisConfig.noiseScale;
+    m_scales[1] = synthesisConfig.lengthScale;
+    m_scales[2] = synthesisConfig.noiseW;
+    m_speakerId[0] = (int64_t)synthesisConfig.speakerId.value_or(0);
+
+    // Shapes change per request, so only the small tensor headers are rebuilt
+    std::array<int64_t, 2> phonemeIdsShape{1, (int64_t)paddedLength};
+    std::array<int64_t, 1> singleShape{1};
+    std::array<int64_t, 1> scalesShape{3};
+    Ort::Value phonemeIdsTensor = Ort::Value::CreateTensor<int64_t>(
+        m_memoryInfo, m_phonemeIds.data(), paddedLength, phonemeIdsShape.data(),
+        phonemeIdsShape.size());
+    Ort::Value lengthsTensor = Ort::Value::CreateTensor<int64_t>(
+        m_memoryInfo, m_phonemeIdLengths.data(), 1, singleShape.data(),
+        singleShape.size());
+    Ort::Value scalesTensor = Ort::Value::CreateTensor<float>(
+        m_memoryInfo, m_scales.data(), 3, scalesShape.data(), scalesShape.size());
+    Ort::Value speakerIdTensor = Ort::Value::CreateTensor<int64_t>(
+        m_memoryInfo, m_speakerId.data(), 1, singleShape.data(), singleShape.size());
+
+    m_binding.ClearBoundInputs();
+    m_binding.BindInput("input", phonemeIdsTensor);
+    m_binding.BindInput("input_lengths", lengthsTensor);
+    m_binding.BindInput("scales", scalesTensor);
+    if (synthesisConfig.speakerId) {
+        m_binding.BindInput("sid", speakerIdTensor);
+    }
+
+    uint64_t startAllocations = 0, startAllocationBytes = 0;
+    bool countAllocations = processAllocations(startAllocations, startAllocationBytes);
+
+    auto startTime = std::chrono::steady_clock::now();
+    m_session.onnx.Run(Ort::RunOptions{nullptr}, m_binding);
+    auto endTime = std::chrono::steady_clock::now();
+    result.inferSeconds = std::chrono::duration<double>(endTime - startTime).count();
+    metrics().stage(Stage::Run).observe(result.inferSeconds);
+
+    m_outputs = m_binding.GetOutputValues();
+    uint64_t allocations = 0, allocationBytes = 0;
+    if (countAllocations && processAllocations(allocations, allocationBytes)) {
+        m_counters.runAllocations += allocations - startAllocations;
+        m_counters.runAllocationBytes += allocationBytes - startAllocationBytes;
+    }
+    size_t outputCount = m_bindOutputLengths ? 2 : 1;
+    if ((m_outputs.size() != outputCount) || (!m_outputs.front().IsTensor())) {
+        throw std::runtime_error("Invalid output tensors");
+    }
+
+    const float *audio = audioData(m_outputs.front(), m_halfScratch);
+    auto audioShape = m_outputs.front().GetTensorTypeAndShapeInfo().GetShape();
+    audioCount = (size_t)audioShape[audioShape.size() - 1];
+    if (m_bindOutputLengths) {
+        audioCount = std::min(audioCount, (size_t)m_outputs[1].GetTensorData<int64_t>()[0]);
+    }
+
+    result.audioSeconds = (double)audioCount / (double)synthesisConfig.sampleRate;
+    result.realTimeFactor = 0.0;
+    if (result.audioSeconds > 0) {
+        result.realTimeFactor = result.inferSeconds / result.audioSeconds;
+    }
+    metrics().recordClause(result);
+    return audio;
+}
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "chunked_decoder.h"
+#include "metrics.h"
+
+std::string encoderModelPath(const std::string &modelPath) {
+    return siblingModelPath(modelPath, "encoder");
+}
+
+std::string decoderModelPath(const std::string &modelPath) {
+    return siblingModelPath(modelPath, "decoder");
+}
+
+bool hasSplitModel(const std::string &modelPath) {
+    struct stat fileStat;
+    return stat(encoderModelPath(modelPath).c_str(), &fileStat) == 0 &&
+           stat(decoderModelPath(modelPath).c_str(), &fileStat) == 0;
+}
+
+ChunkedDecoder::ChunkedDecoder(const std::string &encoderPath,
+                               const std::string &decoderPath, bool useCuda,
+                               ChunkedDecoderConfig config)
+    : m_config(config) {
+    if (m_config.chunkFrames <= 0) {
+        throw std::invalid_argument("chunkFrames must be positive");
+    }
+    m_config.contextFrames = std::max<int64_t>(0, m_config.contextFrames);
+    m_config.crossfadeFrames =
+        std::clamp<int64_t>(m_config.crossfadeFrames, 0, m_config.contextFrames);
+
+    // Both graphs share the encoder's Env
+    loadSessionTuning(defaultTuningPath(encoderPath), m_encoder.tuning);
+    loadModel(encoderPath, m_encoder, useCuda);
+    loadSessionTuning(defaultTuningPath(decoderPath), m_decoder.tuning);
+    configureSession(m_decoder, useCuda);
+    createSession(decoderPath, m_decoder, m_encoder.env);
+
+    for (size_t i = 0; i < m_decoder.onnx.GetInputCount(); i++) {
+        auto name = m_decoder.onnx.GetInputNameAllocated(i, m_decoder.allocator);
+        if (std::string(name.get()) == "sid") {
+            m_decoderTakesSpeaker = true;
+        }
+    }
+}
+
+std::vector<float> ChunkedDecoder::decode(const std::vector<float> &z, int64_t channels,
+                                          int64_t frames, int64_t start, int64_t end,
+                                          const SynthesisConfig &synthesisConfig,
+                                          double &inferSeconds) {
+    auto memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator,
+                                                 OrtMemType::OrtMemTypeDefault);
+
+    // z is [1, C, frames]; cut out [1, C, end - start]
+    int64_t windowFrames = end - start;
+    std::vector<float> window((size_t)(channels * windowFrames));
+    for (int64_t c = 0; c < channels; c++) {
+        std::copy(z.begin() + c * frames + start, z.begin() + c * frames + end,
+                  window.begin() + c * windowFrames);
+    }
+
+    std::vector<Ort::Value> inputTensors;
+    std::array<int64_t, 3> windowShape{1, channels, windowFrames};
+    inputTensors.push_back(Ort::Value::CreateTensor<float>(
+        memoryInfo, window.data(), window.size(), windowShape.data(), windowShape.size()));
+
+    std::array<int64_t, 1> speakerId{(int64_t)synthesisConfig.speakerId.value_or(0)};
+    std::array<int64_t, 1> speakerIdShape{1};
+    if (m_decoderTakesSpeaker) {
+        inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+            memoryInfo, speakerId.data(), speakerId.size(), speakerIdShape.data(),
+            speakerIdShape.size()));
+    }
+
+    std::array<const char *, 2> inputNames = {"z", "sid"};
+    std::array<const char *, 1> outputNames = {"output"};
+    auto startTime = std::chrono::steady_clock::now();
+    auto outputTensors = m_decoder.onnx.Run(
+        Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(),
+        inputTensors.size(), outputNames.data(), outputNames.size());
+    auto endTime = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(endTime - startTime).count();
+    metrics().stage(Stage::Run).observe(seconds);
+    inferSeconds += seconds;
+
+    if ((outputTensors.size() != 1) || (!outputTensors.front().IsTensor())) {
+        throw std::runtime_error("Invalid decoder output tensors");
+    }
+    auto audioShape = outputTensors.front().GetTensorTypeAndShapeInfo().GetShape();
+    int64_t audioCount = audioShape[audioShape.size() - 1];
+    std::vector<float> audio;
+    const float *data = audioData(outputTensors.front(), audio);
+    if (data != audio.data()) {
+        audio.assign(data, data + audioCount);
+    }
+    audio.resize(audioCount);
+    return audio;
+}
+
+void ChunkedDecoder::synthesize(const std::vector<int64_t> &phonemeIds,
+                                const SynthesisConfig &synthesisConfig,
+                                const AudioChunkCallback &onAudio,
+                                SynthesisResult &result, AudioConverter *converter) {
+    auto startTime = std::chrono::steady_clock::now();
+    result = SynthesisResult();
+
+    auto memoryInfo = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator,
+                                                 OrtMemType::OrtMemTypeDefault);
+    std::vector<int64_t> ids = phonemeIds;
+    std::array<int64_t, 1> idLengths{(int64_t)ids.size()};
+    std::array<float, 3> scales{synthesisConfig.noiseScale, synthesisConfig.lengthScale,
+                                synthesisConfig.noiseW};
+    std::array<int64_t, 1> speakerId{(int64_t)synthesisConfig.speakerId.value_or(0)};
+
+    std::vector<Ort::Value> inputTensors;
+    std::array<int64_t, 2> idsShape{1, (int64_t)ids.size()};
+    std::array<int64_t, 1> singleShape{1};
+    std::array<int64_t, 1> scalesShape{3};
+    inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+        memoryInfo, ids.data(), ids.size(), idsShape.data(), idsShape.size()));
+    inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+        memoryInfo, idLengths.data(), idLengths.size(), singleShape.data(),
+        singleShape.size()));
+    inputTensors.push_back(Ort::Value::CreateTensor<float>(
+        memoryInfo, scales.data(), scales.size(), scalesShape.data(), scalesShape.size()));
+    if (synthesisConfig.speakerId) {
+        inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+            memoryInfo, speakerId.data(), speakerId.size(), singleShape.data(),
+            singleShape.size()));
+    }
+
+    std::array<const char *, 4> inputNames = {"input", "input_lengths", "scales", "sid"};
+    std::array<const char *, 1> outputNames = {"z"};
+    auto encodeStart = std::chrono::steady_clock::now();
+    auto outputTensors = m_encoder.onnx.Run(
+        Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(),
+        inputTensors.size(), outputNames.data(), outputNames.size());
+    auto encodeEnd = std::chrono::steady_clock::now();
+    result.inferSeconds = std::chrono::duration<double>(encodeEnd - encodeStart).count();
+    metrics().stage(Stage::Run).observe(result.inferSeconds);
+
+    if ((outputTensors.size() != 1) || (!outputTensors.front().IsTensor())) {
+        throw std::runtime_error("Invalid encoder output tensors");
+    }
+    auto zShape = outputTensors.front().GetTensorTypeAndShapeInfo().GetShape();
+    if (zShape.size() != 3) {
+        throw std::runtime_error("Encoder output z must be [1, C, frames]");
+    }
+    int64_t channels = zShape[1];
+    int64_t frames = zShape[2];
+    // z is fed back to the decoder as float, also for fp16 graphs
+    std::vector<float> z;
+    const float *zData = audioData(outputTensors.front(), z);
+    if (zData != z.data()) {
+        z.assign(zData, zData + channels * frames);
+    }
+
+    AudioConverter chunkConverter(synthesisConfig.gainMode == GainMode::Peak
+                                      ? GainMode::Running
+                                      : synthesisConfig.gainMode,
+                                  synthesisConfig.fixedGain);
+    if (!converter) {
+        converter = &chunkConverter;
+    }
+
+    int64_t fadeFrames = m_config.crossfadeFrames;
+    std::vector<float> tail;
+    std::vector<int16_t> samples;
+    for (int64_t start = 0; start < frames;) {
+        int64_t end = std::min(frames, start + m_config.chunkFrames);
+        int64_t windowStart = std::max<int64_t>(0, start - m_config.contextFrames);
+        int64_t windowEnd = std::min(frames, end + m_config.contextFrames);
+        std::vector<float> audio = decode(z, channels, frames, windowStart, windowEnd,
+                                          synthesisConfig, result.inferSeconds);
+        size_t hop = audio.size() / (size_t)(windowEnd - windowStart);
+        if (hop == 0) {
+            break;
+        }
+
+        // Blend the start of this chunk with the previous decode of the same
+        // frames, then keep this decode's frames past the end for the next one
+        size_t chunkStart = (size_t)(start - windowStart) * hop;
+        size_t chunkEnd = (size_t)(end - windowStart) * hop;
+        size_t fadeLength = std::min(tail.size(), chunkEnd - chunkStart);
+        for (size_t i = 0; i < fadeLength; i++) {
+            float weight = ((float)i + 0.5f) / (float)fadeLength;
+            audio[chunkStart + i] = tail[i] * (1.0f - weight) + audio[chunkStart + i] * weight;
+        }
+        size_t tailEnd = std::min(audio.size(), chunkEnd + (size_t)fadeFrames * hop);
+        tail.assign(audio.begin() + chunkEnd, audio.begin() + tailEnd);
+
+        size_t numSamples = chunkEnd - chunkStart;
+        samples.resize(numSamples);
+        {
+            StageTimer timer(Stage::Postprocess);
+            converter->convert(audio.data() + chunkStart, numSamples, samples.data());
+        }
+        result.audioSeconds += (double)numSamples / (double)synthesisConfig.sampleRate;
+
+        if (start == 0) {
+            auto firstTime = std::chrono::steady_clock::now();
+            result.firstAudioSeconds =
+                std::chrono::duration<double>(firstTime - startTime).count();
+        }
+        start = end;
+
+        StageTimer timer(Stage::Output);
+        if (!onAudio(samples.data(), numSamples)) {
+            break;
+        }
+    }
+
+    if (result.audioSeconds > 0) {
+        result.realTimeFactor = result.inferSeconds / result.audioSeconds;
+    }
+    metrics().recordClause(result);
+}
@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cold_start.h"
+#include "metrics.h"
+#include "symbols.h"
+#include "vits_onnx.h"
+
+MappedModel::MappedModel(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Failed to open model: " + path);
+    }
+
+    m_size = (size_t)fileStat.st_size;
+    m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m_data == MAP_FAILED) {
+        m_data = nullptr;
+        throw std::runtime_error("Failed to map model: " + path);
+    }
+
+    // The whole file is parsed right away
+    madvise(m_data, m_size, MADV_WILLNEED);
+}
+
+MappedModel::~MappedModel() {
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+}
+
+std::string optimizedModelPath(const std::string &modelPath,
+                               const SessionTuning &tuning) {
+    std::string level;
+    switch (tuning.graphOptimizationLevel) {
+    case GraphOptimizationLevel::ORT_DISABLE_ALL:
+        level = "disable_all";
+        break;
+    case GraphOptimizationLevel::ORT_ENABLE_BASIC:
+        level = "basic";
+        break;
+    case GraphOptimizationLevel::ORT_ENABLE_EXTENDED:
+        level = "extended";
+        break;
+    default:
+        level = "all";
+        break;
+    }
+    return modelPath + "." + level + ".ort";
+}
+
+// A cached model is stale once the source model has been replaced
+static bool isUpToDate(const std::string &cachedPath, const std::string &modelPath) {
+    struct stat cachedStat, modelStat;
+    if (stat(cachedPath.c_str(), &cachedStat) != 0 || cachedStat.st_size == 0) {
+        return false;
+    }
+    if (stat(modelPath.c_str(), &modelStat) != 0) {
+        return true;
+    }
+    return cachedStat.st_mtime >= modelStat.st_mtime;
+}
+
+void createSessionCached(const std::string &modelPath, ModelSession &session,
+                         Ort::Env &env, bool useCuda,
+                         const ColdStartConfig &config, ColdStartStats &stats) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::string sourcePath = modelPath;
+    std::string cachedPath;
+    std::string tempPath;
+    if (config.cacheOptimizedModel && !useCuda) {
+        cachedPath = config.optimizedModelPath.empty()
+                         ? optimizedModelPath(modelPath, session.tuning)
+                         : config.optimizedModelPath;
+        if (isUpToDate(cachedPath, modelPath)) {
+            // Already optimized at the tuned level when it was saved
+            sourcePath = cachedPath;
+            session.options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+            session.options.AddConfigEntry("session.load_model_format", "ORT");
+            stats.optimizedModelLoaded = true;
+            metrics().optimizedModelCacheHits.add();
+        } else {
+            metrics().optimizedModelCacheMisses.add();
+            // Written under a temporary name so concurrent starts never load
+            // a partial file
+            tempPath = cachedPath + ".tmp" + std::to_string(getpid());
+            session.options.SetOptimizedModelFilePath(tempPath.c_str());
+            session.options.AddConfigEntry("session.save_model_format", "ORT");
+        }
+    }
+
+    if (config.mapModel) {
+        session.mappedModel = std::make_shared<MappedModel>(sourcePath);
+        if (stats.optimizedModelLoaded) {
+            // The mapping lives as long as the session, so onnxruntime can use
+            // the flatbuffer in place instead of copying it
+            session.options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+        }
+        session.onnx = Ort::Session(env, session.mappedModel->data(),
+                                    session.mappedModel->size(), session.options);
+        inspectSessionOutputs(session);
+    } else {
+        createSession(sourcePath, session, env);
+    }
+
+    if (!tempPath.empty()) {
+        if (std::rename(tempPath.c_str(), cachedPath.c_str()) == 0) {
+            stats.optimizedModelSaved = true;
+        } else {
+            std::remove(tempPath.c_str());
+        }
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    stats.sessionSeconds = std::chrono::duration<double>(endTime - startTime).count();
+    stats.modelFile = sourcePath;
+}
+
+void loadModelCached(const std::string &modelPath, ModelSession &session,
+                     bool useCuda, const ColdStartConfig &config,
+                     ColdStartStats &stats) {
+    session.env = Ort::Env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "vits");
+    session.env.DisableTelemetryEvents();
+
+    configureSession(session, useCuda);
+    createSessionCached(modelPath, session, session.env, useCuda, config, stats);
+}
+
+std::vector<int64_t> warmupSequence(size_t length) {
+    // A phrase repeated to length, so the warm-up runs see the durations of
+    // real speech; without punctuation it stays a single clause
+    static const char32_t phrase[] = U"ðə kwˈaɪət ɹˈɪvɚ kˈɛpt ɑːn ɹˈʌnɪŋ ";
+    static const size_t phraseLength = sizeof(phrase) / sizeof(phrase[0]) - 1;
+    std::vector<int64_t> phonemeIds(length);
+    for (size_t i = 0; i < length; i++) {
+        phonemeIds[i] = symbolToId(phrase[i % phraseLength]);
+    }
+    return phonemeIds;
+}
@@ -0,0 +1,382 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "corpus.h"
+
+namespace fs = std::filesystem;
+
+static void appendUtf8(std::string &str, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+        str += (char)codepoint;
+    } else if (codepoint < 0x800) {
+        str += (char)(0xC0 | (codepoint >> 6));
+        str += (char)(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        str += (char)(0xE0 | (codepoint >> 12));
+        str += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        str += (char)(0x80 | (codepoint & 0x3F));
+    } else {
+        str += (char)(0xF0 | (codepoint >> 18));
+        str += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        str += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        str += (char)(0x80 | (codepoint & 0x3F));
+    }
+}
+
+// Just enough JSON for one flat manifest object per line
+class JsonLine
+{
+public:
+    explicit JsonLine(const std::string &line) : m_line(line) {}
+
+    CorpusItem parseItem() {
+        CorpusItem item;
+        bool hasText = false;
+        expect('{');
+        if (!consume('}')) {
+            do {
+                std::string key = parseString();
+                expect(':');
+                if (key == "id") {
+                    item.id = (peek() == '"') ? parseString() : std::to_string(parseInteger());
+                } else if (key == "text") {
+                    item.text = parseString();
+                    hasText = true;
+                } else if (key == "phoneme_ids") {
+                    expect('[');
+                    if (!consume(']')) {
+                        do {
+                            item.phonemeIds.push_back(parseInteger());
+                        } while (consume(','));
+                        expect(']');
+                    }
+                } else if (key == "speaker") {
+                    item.speakerId = (SpeakerId)parseInteger();
+                } else {
+                    skipValue();
+                }
+            } while (consume(','));
+            expect('}');
+        }
+        skipSpace();
+        if (m_pos != m_line.size()) {
+            fail("trailing characters");
+        }
+        if (hasText == !item.phonemeIds.empty()) {
+            fail("need either \"text\" or \"phoneme_ids\"");
+        }
+        return item;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string &what) {
+        throw std::runtime_error(what + " at column " + std::to_string(m_pos + 1));
+    }
+
+    void skipSpace() {
+        while (m_pos < m_line.size() && std::isspace((unsigned char)m_line[m_pos])) {
+            m_pos++;
+        }
+    }
+
+    char peek() {
+        skipSpace();
+        return (m_pos < m_line.size()) ? m_line[m_pos] : '\0';
+    }
+
+    bool consume(char c) {
+        if (peek() == c) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+    }
+
+    uint32_t parseHex4() {
+        if (m_pos + 4 > m_line.size()) {
+            fail("truncated \\u escape");
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = m_line[m_pos++];
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= (uint32_t)(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                value |= (uint32_t)(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                value |= (uint32_t)(c - 'A' + 10);
+            } else {
+                fail("bad \\u escape");
+            }
+        }
+        return value;
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string value;
+        while (true) {
+            if (m_pos >= m_line.size()) {
+                fail("unterminated string");
+            }
+            char c = m_line[m_pos++];
+            if (c == '"') {
+                return value;
+            }
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (m_pos >= m_line.size()) {
+                fail("unterminated string");
+            }
+            char escape = m_line[m_pos++];
+            switch (escape) {
+            case '"': value += '"'; break;
+            case '\\': value += '\\'; break;
+            case '/': value += '/'; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'u': {
+                uint32_t codepoint = parseHex4();
+                // Surrogate pair for codepoints above the BMP
+                if (codepoint >= 0xD800 && codepoint < 0xDC00 &&
+                    m_line.compare(m_pos, 2, "\\u") == 0) {
+                    m_pos += 2;
+                    uint32_t low = parseHex4();
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(value, codepoint);
+                break;
+            }
+            default:
+                fail("bad escape");
+            }
+        }
+    }
+
+    int64_t parseInteger() {
+        skipSpace();
+        size_t used = 0;
+        int64_t value = 0;
+        try {
+            value = std::stoll(m_line.substr(m_pos), &used);
+        } catch (const std::exception &) {
+            fail("expected an integer");
+        }
+        m_pos += used;
+        return value;
+    }
+
+    void skipValue() {
+        char c = peek();
+        if (c == '"') {
+            parseString();
+        } else if (c == '{' || c == '[') {
+            char close = (c == '{') ? '}' : ']';
+            m_pos++;
+            if (consume(close)) {
+                return;
+            }
+            do {
+                if (close == '}') {
+                    parseString();
+                    expect(':');
+                }
+                skipValue();
+            } while (consume(','));
+            expect(close);
+        } else {
+            // Numbers, true, false, null
+            size_t start = m_pos;
+            while (m_pos < m_line.size() && std::strchr(",}] \t", m_line[m_pos]) == nullptr) {
+                m_pos++;
+            }
+            if (m_pos == start) {
+                fail("expected a value");
+            }
+        }
+    }
+
+    const std::string &m_line;
+    size_t m_pos = 0;
+};
+
+static std::vector<std::string> splitTabs(const std::string &line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (tab == std::string::npos) {
+            return fields;
+        }
+        start = tab + 1;
+    }
+}
+
+static std::vector<int64_t> parseIdList(const std::string &field) {
+    std::vector<int64_t> ids;
+    std::istringstream stream(field);
+    int64_t id;
+    while (stream >> id) {
+        ids.push_back(id);
+    }
+    if (!stream.eof()) {
+        throw std::runtime_error("bad phoneme id list");
+    }
+    return ids;
+}
+
+std::vector<CorpusItem> readCorpusManifest(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open manifest " + path);
+    }
+    std::string extension = fs::path(path).extension().string();
+    bool json = (extension == ".jsonl" || extension == ".json");
+
+    std::vector<std::string> columns = {"id", "text", "speaker"};
+    std::vector<CorpusItem> items;
+    std::unordered_set<std::string> ids;
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.find_first_not_of(" \t") == std::string::npos || line[0] == '#') {
+            continue;
+        }
+        try {
+            CorpusItem item;
+            if (json) {
+                item = JsonLine(line).parseItem();
+            } else if (lineNumber == 1 && line.compare(0, 3, "id\t") == 0) {
+                columns = splitTabs(line);
+                continue;
+            } else {
+                std::vector<std::string> fields = splitTabs(line);
+                for (size_t c = 0; c < fields.size() && c < columns.size(); c++) {
+                    if (columns[c] == "id") {
+                        item.id = fields[c];
+                    } else if (columns[c] == "text") {
+                        item.text = fields[c];
+                    } else if (columns[c] == "phoneme_ids") {
+                        item.phonemeIds = parseIdList(fields[c]);
+                    } else if (columns[c] == "speaker" && !fields[c].empty()) {
+                        item.speakerId = (SpeakerId)std::stoll(fields[c]);
+                    }
+                }
+                if (item.text.empty() && item.phonemeIds.empty()) {
+                    throw std::runtime_error("no text or phoneme ids");
+                }
+            }
+            if (item.id.empty()) {
+                throw std::runtime_error("missing id");
+            }
+            if (item.id.find_first_of("\t\n\r") != std::string::npos) {
+                throw std::runtime_error("id contains a tab or line break");
+            }
+            if (!ids.insert(item.id).second) {
+                throw std::runtime_error("duplicate id " + item.id);
+            }
+            item.index = items.size();
+            items.push_back(std::move(item));
+        } catch (const std::exception &e) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " +
+                                     e.what());
+        }
+    }
+    return items;
+}
+
+std::string corpusOutputName(const std::string &pattern, const CorpusItem &item) {
+    char index[32];
+    snprintf(index, sizeof(index), "%08zu", item.index);
+    std::string speaker = item.speakerId ? std::to_string(*item.speakerId) : "0";
+
+    std::string name;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] == '{') {
+            size_t close = pattern.find('}', i);
+            std::string key = pattern.substr(i + 1, close - i - 1);
+            if (close != std::string::npos &&
+                (key == "id" || key == "index" || key == "speaker")) {
+                name += (key == "id") ? item.id : (key == "index") ? index : speaker;
+                i = close;
+                continue;
+            }
+        }
+        name += pattern[i];
+    }
+
+    fs::path path(name);
+    if (name.empty() || path.is_absolute()) {
+        throw std::invalid_argument("Bad output name '" + name + "' for " + item.id);
+    }
+    for (const fs::path &part : path) {
+        if (part == "..") {
+            throw std::invalid_argument("Output name '" + name + "' leaves the directory");
+        }
+    }
+    return name;
+}
+
+CorpusCheckpoint::CorpusCheckpoint(const std::string &directory,
+                                   const std::string &workerName)
+    : m_path((fs::path(directory) / ("progress-" + workerName + ".tsv")).string()) {
+    fs::create_directories(directory);
+    m_file.open(m_path, std::ios::app);
+    if (!m_file) {
+        throw std::runtime_error("Cannot open checkpoint " + m_path);
+    }
+}
+
+void CorpusCheckpoint::markDone(const std::string &id, double audioSeconds) {
+    m_file << id << "\t" << audioSeconds << "\n";
+    m_file.flush();
+    if (!m_file) {
+        throw std::runtime_error("Failed to write checkpoint " + m_path);
+    }
+}
+
+std::unordered_map<std::string, double>
+CorpusCheckpoint::finishedItems(const std::string &directory) {
+    std::unordered_map<std::string, double> finished;
+    std::error_code error;
+    for (const fs::directory_entry &entry : fs::directory_iterator(directory, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, 9, "progress-") != 0 || entry.path().extension() != ".tsv") {
+            continue;
+        }
+        std::ifstream file(entry.path());
+        std::string line;
+        while (std::getline(file, line)) {
+            // A line cut short by a crash has no tab yet and doesn't count
+            size_t tab = line.find('\t');
+            if (tab == std::string::npos) {
+                continue;
+            }
+            finished[line.substr(0, tab)] = std::atof(line.c_str() + tab + 1);
+        }
+    }
+    return finished;
+}
@@ -0,0 +1,199 @@
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "document_synthesizer.h"
+#include "bounded_queue.h"
+#include "metrics.h"
+#include "phonemizer_pool.h"
+#include "resampler.h"
+#include "silence.h"
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<std::string> splitSentences(const std::string &document) {
+    std::vector<std::string> sentences;
+    std::string current;
+    auto flush = [&]() {
+        size_t start = current.find_first_not_of(" \t\r\n");
+        if (start != std::string::npos) {
+            size_t end = current.find_last_not_of(" \t\r\n");
+            sentences.push_back(current.substr(start, end - start + 1));
+        }
+        current.clear();
+    };
+
+    for (size_t i = 0; i < document.size(); i++) {
+        char c = document[i];
+        current += c;
+        if (c == '.' || c == '!' || c == '?') {
+            // Closing quotes and brackets stay with their sentence
+            size_t next = i + 1;
+            while (next < document.size() && std::strchr("\"')]", document[next])) {
+                next++;
+            }
+            if (next == document.size() || std::isspace((unsigned char)document[next])) {
+                current.append(document, i + 1, next - (i + 1));
+                i = next - 1;
+                flush();
+            }
+        } else if (c == '\n') {
+            // Blank line: paragraph break
+            size_t next = i + 1;
+            if (next < document.size() && document[next] == '\r') {
+                next++;
+            }
+            if (next < document.size() && document[next] == '\n') {
+                flush();
+            }
+        }
+    }
+    flush();
+    return sentences;
+}
+
+const char *documentStageName(DocumentStage stage) {
+    switch (stage) {
+    case DocumentStage::Phonemize:
+        return "phonemize";
+    case DocumentStage::Infer:
+        return "infer";
+    case DocumentStage::Output:
+        return "output";
+    default:
+        return "unknown";
+    }
+}
+
+DocumentSynthesizer::DocumentSynthesizer(ModelSession &session, DocumentConfig config)
+    : m_session(session), m_config(std::move(config)) {}
+
+DocumentStats DocumentSynthesizer::synthesize(const std::string &document,
+                                              const AudioChunkCallback &onAudio) {
+    auto wallStart = std::chrono::steady_clock::now();
+    DocumentStats stats;
+    std::vector<std::string> sentences = splitSentences(document);
+    stats.sentences = sentences.size();
+
+    BoundedQueue<std::vector<int64_t>> phonemeQueue(m_config.queueDepth);
+    BoundedQueue<std::vector<int16_t>> audioQueue(m_config.queueDepth);
+
+    // The first failure stops every stage
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto fail = [&](std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) {
+                error = e;
+            }
+        }
+        phonemeQueue.cancel();
+        audioQueue.cancel();
+    };
+
+    std::thread phonemizer([&]() {
+        DocumentStageStats &stage = stats.stage(DocumentStage::Phonemize);
+        try {
+            eSpeakPhonemeConfig eSpeakConfig = m_config.eSpeakConfig;
+            for (const std::string &sentence : sentences) {
+                auto startTime = std::chrono::steady_clock::now();
+                std::vector<int64_t> phonemeIds;
+                if (m_config.phonemizerPool) {
+                    phonemeIds = m_config.phonemizerPool->textToSequence(sentence, eSpeakConfig);
+                } else {
+                    std::lock_guard<std::mutex> lock(eSpeakMutex());
+                    phonemeIds = text_to_sequence(sentence, eSpeakConfig);
+                }
+                stage.busySeconds += secondsSince(startTime);
+                stage.items++;
+
+                if (!phonemeIds.empty() && !phonemeQueue.push(std::move(phonemeIds))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        phonemeQueue.close();
+    });
+
+    std::thread inference([&]() {
+        DocumentStageStats &stage = stats.stage(DocumentStage::Infer);
+        try {
+            SynthesisConfig synthesisConfig = m_config.synthesisConfig;
+            Resampler resampler(synthesisConfig.sampleRate, synthesisConfig.outputRate());
+            std::vector<int64_t> phonemeIds;
+            bool stopped = false;
+            while (phonemeQueue.pop(phonemeIds)) {
+                auto startTime = std::chrono::steady_clock::now();
+                std::vector<int16_t> audio;
+                SynthesisResult result;
+                SynthesizeClauses(phonemeIds, synthesisConfig, m_session, audio, result);
+                if (!resampler.passthrough()) {
+                    std::vector<int16_t> resampled;
+                    resampler.process(audio.data(), audio.size(), resampled);
+                    audio.swap(resampled);
+                }
+                stage.busySeconds += secondsSince(startTime);
+                stage.items++;
+
+                if (!audioQueue.push(std::move(audio))) {
+                    stopped = true;
+                    break;
+                }
+            }
+            if (!stopped && !resampler.passthrough()) {
+                // Tail of the resampling filter after the last sentence
+                std::vector<int16_t> tail;
+                resampler.flush(tail);
+                if (!tail.empty()) {
+                    audioQueue.push(std::move(tail));
+                }
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        audioQueue.close();
+    });
+
+    DocumentStageStats &output = stats.stage(DocumentStage::Output);
+    try {
+        std::vector<int16_t> audio;
+        while (audioQueue.pop(audio)) {
+            auto startTime = std::chrono::steady_clock::now();
+            bool keepGoing = onAudio(audio.data(), audio.size());
+            output.busySeconds += secondsSince(startTime);
+            output.items++;
+            stats.audioSeconds +=
+                (double)audio.size() / (double)m_config.synthesisConfig.outputRate();
+
+            if (!keepGoing) {
+                phonemeQueue.cancel();
+                audioQueue.cancel();
+                break;
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    phonemizer.join();
+    inference.join();
+
+    stats.wallSeconds = secondsSince(wallStart);
+    for (DocumentStageStats &stage : stats.stages) {
+        if (stats.wallSeconds > 0) {
+            stage.utilization = stage.busySeconds / stats.wallSeconds;
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return stats;
+}
@@ -0,0 +1,254 @@
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "metrics.h"
+#include "vits_onnx.h"
+
+void Histogram::observe(double seconds) {
+    size_t bucket = 0;
+    while (bucket < NUM_BUCKETS - 1 && seconds > bucketBound(bucket)) {
+        bucket++;
+    }
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumNanoseconds.fetch_add((uint64_t)(seconds * 1e9), std::memory_order_relaxed);
+}
+
+double Histogram::quantile(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(q * (double)total);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        seen += bucketCount(bucket);
+        if (seen > rank) {
+            return bucketBound(bucket);
+        }
+    }
+    return bucketBound(NUM_BUCKETS - 1);
+}
+
+const char *stageName(Stage stage) {
+    switch (stage) {
+    case Stage::Phonemize:
+        return "phonemize";
+    case Stage::Symbols:
+        return "symbols";
+    case Stage::Run:
+        return "run";
+    case Stage::Postprocess:
+        return "postprocess";
+    case Stage::Output:
+        return "output";
+    default:
+        return "unknown";
+    }
+}
+
+void SynthesisMetrics::recordClause(const SynthesisResult &result) {
+    clauses.add();
+    audioMicroseconds.add((uint64_t)(result.audioSeconds * 1e6));
+    inferMicroseconds.add((uint64_t)(result.inferSeconds * 1e6));
+}
+
+void SynthesisMetrics::recordColdStart(const ColdStartStats &stats) {
+    coldStartSessionMicroseconds.set((int64_t)(stats.sessionSeconds * 1e6));
+    coldStartWarmupMicroseconds.set((int64_t)(stats.warmupSeconds * 1e6));
+    coldStartTotalMicroseconds.set((int64_t)(stats.coldStartSeconds * 1e6));
+}
+
+SynthesisMetrics &metrics() {
+    static SynthesisMetrics instance;
+    return instance;
+}
+
+uint64_t residentMemoryBytes() {
+    // statm: size resident shared text lib data dt, in pages
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (!(statm >> size >> resident)) {
+        return 0;
+    }
+    return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+uint64_t peakResidentMemoryBytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+}
+
+bool resetPeakResidentMemory() {
+    // Writing 5 resets VmHWM (Linux 4.0+)
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.flush();
+    return (bool)clearRefs;
+}
+
+// Defined by bench/malloc_counter.cpp; null when it isn't linked in
+extern "C" __attribute__((weak)) void vitsMallocCounts(uint64_t *count, uint64_t *bytes);
+
+bool processAllocations(uint64_t &count, uint64_t &bytes) {
+    if (!vitsMallocCounts) {
+        return false;
+    }
+    vitsMallocCounts(&count, &bytes);
+    return true;
+}
+
+static double hitRate(const Counter &hits, const Counter &misses) {
+    uint64_t total = hits.value() + misses.value();
+    return total ? (double)hits.value() / (double)total : 0.0;
+}
+
+static double realTimeFactor(SynthesisMetrics &m) {
+    uint64_t audio = m.audioMicroseconds.value();
+    return audio ? (double)m.inferMicroseconds.value() / (double)audio : 0.0;
+}
+
+std::string exportPrometheus() {
+    SynthesisMetrics &m = metrics();
+    std::ostringstream out;
+
+    out << "# HELP vits_stage_seconds Latency of one synthesis stage\n"
+        << "# TYPE vits_stage_seconds histogram\n";
+    for (size_t s = 0; s < (size_t)Stage::Count; s++) {
+        const char *name = stageName((Stage)s);
+        const Histogram &histogram = m.stages[s];
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < Histogram::NUM_BUCKETS - 1; bucket++) {
+            cumulative += histogram.bucketCount(bucket);
+            out << "vits_stage_seconds_bucket{stage=\"" << name << "\",le=\""
+                << Histogram::bucketBound(bucket) << "\"} " << cumulative << "\n";
+        }
+        out << "vits_stage_seconds_bucket{stage=\"" << name << "\",le=\"+Inf\"} "
+            << histogram.count() << "\n"
+            << "vits_stage_seconds_sum{stage=\"" << name << "\"} "
+            << histogram.sumSeconds() << "\n"
+            << "vits_stage_seconds_count{stage=\"" << name << "\"} "
+            << histogram.count() << "\n";
+    }
+
+    out << "# HELP vits_clauses_total Synthesized clauses (utterances span one or more)\n"
+        << "# TYPE vits_clauses_total counter\n"
+        << "vits_clauses_total " << m.clauses.value() << "\n"
+        << "# HELP vits_audio_seconds_total Audio produced\n"
+        << "# TYPE vits_audio_seconds_total counter\n"
+        << "vits_audio_seconds_total " << m.audioMicroseconds.value() * 1e-6 << "\n"
+        << "# HELP vits_infer_seconds_total Time spent in Session::Run\n"
+        << "# TYPE vits_infer_seconds_total counter\n"
+        << "vits_infer_seconds_total " << m.inferMicroseconds.value() * 1e-6 << "\n"
+        << "# HELP vits_real_time_factor Infer seconds per audio second since start\n"
+        << "# TYPE vits_real_time_factor gauge\n"
+        << "vits_real_time_factor " << realTimeFactor(m) << "\n"
+        << "# HELP vits_queue_depth Requests waiting for a batch or a worker\n"
+        << "# TYPE vits_queue_depth gauge\n"
+        << "vits_queue_depth " << m.queueDepth.value() << "\n"
+        << "# HELP vits_stream_errors_total Streamed responses cut off by a synthesis failure\n"
+        << "# TYPE vits_stream_errors_total counter\n"
+        << "vits_stream_errors_total " << m.streamErrors.value() << "\n"
+        << "# HELP vits_cold_start_seconds Phases of the most recent cold start\n"
+        << "# TYPE vits_cold_start_seconds gauge\n"
+        << "vits_cold_start_seconds{phase=\"session\"} "
+        << m.coldStartSessionMicroseconds.value() * 1e-6 << "\n"
+        << "vits_cold_start_seconds{phase=\"warmup\"} "
+        << m.coldStartWarmupMicroseconds.value() * 1e-6 << "\n"
+        << "vits_cold_start_seconds{phase=\"total\"} "
+        << m.coldStartTotalMicroseconds.value() * 1e-6 << "\n"
+        << "# HELP vits_resident_memory_bytes Resident set size of the process\n"
+        << "# TYPE vits_resident_memory_bytes gauge\n"
+        << "vits_resident_memory_bytes " << residentMemoryBytes() << "\n"
+        << "# HELP vits_peak_resident_memory_bytes Resident set high-water mark of the process\n"
+        << "# TYPE vits_peak_resident_memory_bytes gauge\n"
+        << "vits_peak_resident_memory_bytes " << peakResidentMemoryBytes() << "\n"
+        << "# HELP vits_cache_requests_total Cache lookups by result\n"
+        << "# TYPE vits_cache_requests_total counter\n"
+        << "vits_cache_requests_total{cache=\"phoneme\",result=\"hit\"} "
+        << m.phonemeCacheHits.value() << "\n"
+        << "vits_cache_requests_total{cache=\"phoneme\",result=\"miss\"} "
+        << m.phonemeCacheMisses.value() << "\n"
+        << "vits_cache_requests_total{cache=\"audio\",result=\"hit\"} "
+        << m.audioCacheHits.value() << "\n"
+        << "vits_cache_requests_total{cache=\"audio\",result=\"miss\"} "
+        << m.audioCacheMisses.value() << "\n"
+        << "vits_cache_requests_total{cache=\"optimized_model\",result=\"hit\"} "
+        << m.optimizedModelCacheHits.value() << "\n"
+        << "vits_cache_requests_total{cache=\"optimized_model\",result=\"miss\"} "
+        << m.optimizedModelCacheMisses.value() << "\n";
+    return out.str();
+}
+
+std::string exportJson() {
+    SynthesisMetrics &m = metrics();
+    std::ostringstream out;
+    out << "{\"clauses\": " << m.clauses.value()
+        << ", \"audio_seconds\": " << m.audioMicroseconds.value() * 1e-6
+        << ", \"infer_seconds\": " << m.inferMicroseconds.value() * 1e-6
+        << ", \"real_time_factor\": " << realTimeFactor(m)
+        << ", \"queue_depth\": " << m.queueDepth.value()
+        << ", \"stream_errors\": " << m.streamErrors.value()
+        << ", \"resident_memory_bytes\": " << residentMemoryBytes()
+        << ", \"peak_resident_memory_bytes\": " << peakResidentMemoryBytes()
+        << ", \"phoneme_cache\": {\"hits\": " << m.phonemeCacheHits.value()
+        << ", \"misses\": " << m.phonemeCacheMisses.value()
+        << ", \"hit_rate\": " << hitRate(m.phonemeCacheHits, m.phonemeCacheMisses) << "}"
+        << ", \"audio_cache\": {\"hits\": " << m.audioCacheHits.value()
+        << ", \"misses\": " << m.audioCacheMisses.value()
+        << ", \"hit_rate\": " << hitRate(m.audioCacheHits, m.audioCacheMisses) << "}"
+        << ", \"optimized_model_cache\": {\"hits\": " << m.optimizedModelCacheHits.value()
+        << ", \"misses\": " << m.optimizedModelCacheMisses.value()
+        << ", \"hit_rate\": "
+        << hitRate(m.optimizedModelCacheHits, m.optimizedModelCacheMisses) << "}"
+        << ", \"cold_start\": {\"session_seconds\": "
+        << m.coldStartSessionMicroseconds.value() * 1e-6
+        << ", \"warmup_seconds\": " << m.coldStartWarmupMicroseconds.value() * 1e-6
+        << ", \"total_seconds\": " << m.coldStartTotalMicroseconds.value() * 1e-6 << "}"
+        << ", \"stages\": {";
+    for (size_t s = 0; s < (size_t)Stage::Count; s++) {
+        const Histogram &histogram = m.stages[s];
+        double meanMs = histogram.count()
+                            ? histogram.sumSeconds() * 1e3 / (double)histogram.count()
+                            : 0.0;
+        out << (s ? ", " : "") << "\"" << stageName((Stage)s) << "\": {"
+            << "\"count\": " << histogram.count()
+            << ", \"mean_ms\": " << meanMs
+            << ", \"p50_ms\": " << histogram.quantile(0.50) * 1e3
+            << ", \"p99_ms\": " << histogram.quantile(0.99) * 1e3 << "}";
+    }
+    out << "}}";
+    return out.str();
+}
+
+MetricsReporter::MetricsReporter(std::function<void(const std::string &)> sink,
+                                 std::chrono::milliseconds interval)
+    : m_sink(std::move(sink)), m_interval(interval) {
+    m_thread = std::thread(&MetricsReporter::run, this);
+}
+
+MetricsReporter::~MetricsReporter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+void MetricsReporter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, m_interval, [this]() { return m_stopping; })) {
+        lock.unlock();
+        m_sink(exportJson());
+        lock.lock();
+    }
+}
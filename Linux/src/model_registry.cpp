@@ -0,0 +1,193 @@
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+
+#include "model_registry.h"
+#include "metrics.h"
+#include "phonemizer_pool.h"
+#include "silence.h"
+
+static Ort::Env createSharedEnv(const ModelRegistryConfig &config) {
+    Ort::ThreadingOptions threadingOptions;
+    if (config.intraOpThreads > 0) {
+        threadingOptions.SetGlobalIntraOpNumThreads(config.intraOpThreads);
+    }
+    if (config.interOpThreads > 0) {
+        threadingOptions.SetGlobalInterOpNumThreads(config.interOpThreads);
+    }
+    Ort::Env env(threadingOptions, OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "vits");
+    env.DisableTelemetryEvents();
+    return env;
+}
+
+ModelRegistry::ModelRegistry(ModelRegistryConfig config)
+    : m_config(config), m_env(createSharedEnv(m_config)) {
+    initializeESpeak(m_config.espeakDataPath);
+}
+
+void ModelRegistry::add(const std::string &name, VoiceConfig voice) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(name);
+    if (it != m_entries.end()) {
+        unloadLocked(it->second, false);
+        it->second.voice = std::move(voice);
+        it->second.generation++;
+        return;
+    }
+    Entry &entry = m_entries[name];
+    entry.voice = std::move(voice);
+    entry.stats.name = name;
+}
+
+bool ModelRegistry::contains(const std::string &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.count(name) > 0;
+}
+
+std::shared_ptr<LoadedModel> ModelRegistry::acquire(const std::string &name) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry &entry = m_entries.at(name);
+        entry.stats.requests++;
+        if (entry.model) {
+            m_lru.splice(m_lru.begin(), m_lru, entry.lruPosition);
+            return entry.model;
+        }
+    }
+
+    std::lock_guard<std::mutex> loadLock(m_loadMutex);
+    while (true) {
+        VoiceConfig voice;
+        uint64_t generation;
+        {
+            // Another thread may have loaded it while we waited
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Entry &entry = m_entries.at(name);
+            if (entry.model) {
+                m_lru.splice(m_lru.begin(), m_lru, entry.lruPosition);
+                return entry.model;
+            }
+            voice = entry.voice;
+            generation = entry.generation;
+        }
+
+        ModelStats loadStats;
+        std::shared_ptr<LoadedModel> model = load(name, voice, loadStats);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry &entry = m_entries.at(name);
+        if (entry.generation != generation) {
+            // add() replaced the voice during the load; load the new one
+            continue;
+        }
+        entry.model = model;
+        entry.stats.loaded = true;
+        entry.stats.memoryBytes = loadStats.memoryBytes;
+        entry.stats.loadSeconds = loadStats.loadSeconds;
+        entry.stats.loads++;
+        m_lru.push_front(name);
+        entry.lruPosition = m_lru.begin();
+        m_memoryBytes += entry.stats.memoryBytes;
+        evictOverBudgetLocked(name);
+        return model;
+    }
+}
+
+std::shared_ptr<LoadedModel> ModelRegistry::load(const std::string &name,
+                                                 const VoiceConfig &voice,
+                                                 ModelStats &loadStats) {
+    auto startTime = std::chrono::steady_clock::now();
+    uint64_t residentBefore = residentMemoryBytes();
+
+    auto model = std::make_shared<LoadedModel>();
+    model->name = name;
+    model->eSpeakConfig.voice = voice.espeakVoice;
+    model->synthesisConfig.sampleRate = voice.sampleRate;
+    model->synthesisConfig.speakerId = voice.speakerId;
+
+    ModelSession &session = model->session;
+    session.memoryBudget = m_config.runMemoryBudget;
+    loadSessionTuning(defaultTuningPath(voice.modelPath), session.tuning);
+    configureSession(session, m_config.useCuda);
+
+    // Run on the Env's global thread pools instead of starting new ones
+    session.options.DisablePerSessionThreads();
+    createSession(voice.modelPath, session, m_env);
+
+    auto endTime = std::chrono::steady_clock::now();
+    loadStats.loadSeconds = std::chrono::duration<double>(endTime - startTime).count();
+
+    // Weights dominate; the RSS delta also covers what onnxruntime allocated,
+    // and anything other voices' inference allocated meanwhile
+    uint64_t residentAfter = residentMemoryBytes();
+    uint64_t residentDelta = (residentAfter > residentBefore) ? residentAfter - residentBefore : 0;
+    std::error_code error;
+    uint64_t fileBytes = std::filesystem::file_size(voice.modelPath, error);
+    if (error) {
+        fileBytes = 0;
+    }
+    loadStats.memoryBytes = std::max(residentDelta, fileBytes);
+    return model;
+}
+
+void ModelRegistry::unloadLocked(Entry &entry, bool eviction) {
+    if (!entry.model) {
+        return;
+    }
+    entry.model.reset();
+    m_lru.erase(entry.lruPosition);
+    m_memoryBytes -= entry.stats.memoryBytes;
+    entry.stats.loaded = false;
+    if (eviction) {
+        entry.stats.evictions++;
+    }
+}
+
+void ModelRegistry::evictOverBudgetLocked(const std::string &keep) {
+    // The voice that was just loaded stays even if it alone exceeds the budget
+    while (m_memoryBytes > m_config.memoryBudgetBytes && m_lru.size() > 1) {
+        const std::string &victim = (m_lru.back() == keep) ? *std::prev(m_lru.end(), 2)
+                                                           : m_lru.back();
+        unloadLocked(m_entries.at(victim), true);
+    }
+}
+
+void ModelRegistry::synthesize(const std::string &name, const std::string &text,
+                               std::vector<int16_t> &audioBuffer,
+                               SynthesisResult &result) {
+    std::shared_ptr<LoadedModel> model = acquire(name);
+
+    std::vector<int64_t> phonemeIds;
+    if (m_config.phonemizerPool) {
+        phonemeIds = m_config.phonemizerPool->textToSequence(text, model->eSpeakConfig);
+    } else {
+        // espeak-ng is process-global and the voice changes per model
+        std::lock_guard<std::mutex> lock(eSpeakMutex());
+        eSpeakPhonemeConfig eSpeakConfig = model->eSpeakConfig;
+        phonemeIds = text_to_sequence(text, eSpeakConfig);
+    }
+    SynthesisConfig synthesisConfig = model->synthesisConfig;
+    SynthesizeClauses(phonemeIds, synthesisConfig, model->session, audioBuffer, result);
+}
+
+void ModelRegistry::evict(const std::string &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(name);
+    if (it != m_entries.end()) {
+        unloadLocked(it->second, true);
+    }
+}
+
+uint64_t ModelRegistry::memoryBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryBytes;
+}
+
+std::vector<ModelStats> ModelRegistry::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<ModelStats> stats;
+    for (const auto &entry : m_entries) {
+        stats.push_back(entry.second.stats);
+    }
+    return stats;
+}
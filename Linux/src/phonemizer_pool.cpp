@@ -0,0 +1,573 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "phonemizer_pool.h"
+#include "metrics.h"
+#include "vits_onnx.h"
+
+namespace {
+
+enum MessageKind : uint32_t { SequenceMessage = 1, ClausesMessage = 2, QuitMessage = 3 };
+
+struct WorkerExited : std::runtime_error {
+    WorkerExited() : std::runtime_error("Phonemizer worker exited") {}
+};
+
+// Start of each ring in shared memory; the data follows it
+struct alignas(64) RingHeader {
+    // Total bytes ever written and read; their difference is the fill level
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> read{0};
+
+    // Set by a side that is about to block, so the other side only posts
+    // when someone may be waiting
+    std::atomic<uint32_t> readerWaiting{0};
+    std::atomic<uint32_t> writerWaiting{0};
+    sem_t dataReady;
+    sem_t spaceReady;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Ring counters must be lock-free to be shared between processes");
+
+// Single-producer, single-consumer byte stream between two processes
+class Ring
+{
+public:
+    static size_t bytesNeeded(size_t capacity) { return sizeof(RingHeader) + capacity; }
+
+    void attach(void *memory, size_t capacity) {
+        m_header = static_cast<RingHeader *>(memory);
+        m_data = static_cast<char *>(memory) + sizeof(RingHeader);
+        m_capacity = capacity;
+    }
+
+    // (Re)initializes the shared state; no other process may be using it
+    void reset() {
+        if (m_initialized) {
+            sem_destroy(&m_header->dataReady);
+            sem_destroy(&m_header->spaceReady);
+        }
+        new (m_header) RingHeader();
+        sem_init(&m_header->dataReady, /*pshared*/ 1, 0);
+        sem_init(&m_header->spaceReady, /*pshared*/ 1, 0);
+        m_initialized = true;
+    }
+
+    // Process on the other end; blocking waits give up once it has exited
+    void setPeer(pid_t peer) { m_peer = peer; }
+
+    void write(const void *data, size_t size) {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0) {
+            uint64_t written = m_header->written.load();
+            size_t space = m_capacity - (size_t)(written - m_header->read.load());
+            if (space == 0) {
+                m_header->writerWaiting.store(1);
+                if (m_header->written.load() - m_header->read.load() == m_capacity) {
+                    block(&m_header->spaceReady);
+                }
+                continue;
+            }
+            size_t offset = (size_t)(written % m_capacity);
+            size_t count = std::min({size, space, m_capacity - offset});
+            std::memcpy(m_data + offset, bytes, count);
+            m_header->written.store(written + count);
+            if (m_header->readerWaiting.exchange(0) != 0) {
+                sem_post(&m_header->dataReady);
+            }
+            bytes += count;
+            size -= count;
+        }
+    }
+
+    void read(void *data, size_t size) {
+        char *bytes = static_cast<char *>(data);
+        while (size > 0) {
+            uint64_t read = m_header->read.load();
+            size_t available = (size_t)(m_header->written.load() - read);
+            if (available == 0) {
+                m_header->readerWaiting.store(1);
+                if (m_header->written.load() == m_header->read.load()) {
+                    block(&m_header->dataReady);
+                }
+                continue;
+            }
+            size_t offset = (size_t)(read % m_capacity);
+            size_t count = std::min({size, available, m_capacity - offset});
+            std::memcpy(bytes, m_data + offset, count);
+            m_header->read.store(read + count);
+            if (m_header->writerWaiting.exchange(0) != 0) {
+                sem_post(&m_header->spaceReady);
+            }
+            bytes += count;
+            size -= count;
+        }
+    }
+
+private:
+    void block(sem_t *semaphore) {
+        while (true) {
+            int error;
+            if (m_peer <= 0) {
+                if (sem_wait(semaphore) == 0) {
+                    return;
+                }
+                error = errno;
+            } else {
+                // Wake up now and then to notice a peer that died
+                timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_nsec += 100 * 1000 * 1000;
+                if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000 * 1000 * 1000;
+                }
+                if (sem_timedwait(semaphore, &deadline) == 0) {
+                    return;
+                }
+                error = errno;
+                // The zygote reaps helpers as they exit, so a dead one's pid is gone
+                if (error == ETIMEDOUT && kill(m_peer, 0) != 0 && errno == ESRCH) {
+                    throw WorkerExited();
+                }
+            }
+            if (error != EINTR && error != ETIMEDOUT) {
+                throw std::runtime_error(std::string("Ring wait failed: ") +
+                                         std::strerror(error));
+            }
+        }
+    }
+
+    RingHeader *m_header = nullptr;
+    char *m_data = nullptr;
+    size_t m_capacity = 0;
+    pid_t m_peer = 0;
+    bool m_initialized = false;
+};
+
+class MessageWriter
+{
+public:
+    void u32(uint32_t value) { append(&value, sizeof(value)); }
+    void i64(int64_t value) { append(&value, sizeof(value)); }
+    void str(const std::string &value) {
+        u32((uint32_t)value.size());
+        append(value.data(), value.size());
+    }
+    const std::string &bytes() const { return m_bytes; }
+
+private:
+    void append(const void *data, size_t size) {
+        m_bytes.append(static_cast<const char *>(data), size);
+    }
+
+    std::string m_bytes;
+};
+
+class MessageReader
+{
+public:
+    explicit MessageReader(const std::string &bytes)
+        : m_position(bytes.data()), m_end(bytes.data() + bytes.size()) {}
+
+    uint32_t u32() { return value<uint32_t>(); }
+    int64_t i64() { return value<int64_t>(); }
+    std::string str() {
+        uint32_t size = u32();
+        need(size);
+        std::string result(m_position, size);
+        m_position += size;
+        return result;
+    }
+
+private:
+    template <typename T> T value() {
+        need(sizeof(T));
+        T result;
+        std::memcpy(&result, m_position, sizeof(T));
+        m_position += sizeof(T);
+        return result;
+    }
+    void need(size_t size) {
+        if ((size_t)(m_end - m_position) < size) {
+            throw std::runtime_error("Truncated phonemizer message");
+        }
+    }
+
+    const char *m_position;
+    const char *m_end;
+};
+
+void sendMessage(Ring &ring, const std::string &bytes) {
+    uint32_t size = (uint32_t)bytes.size();
+    ring.write(&size, sizeof(size));
+    ring.write(bytes.data(), bytes.size());
+}
+
+std::string receiveMessage(Ring &ring) {
+    uint32_t size = 0;
+    ring.read(&size, sizeof(size));
+    std::string bytes(size, '\0');
+    ring.read(&bytes[0], size);
+    return bytes;
+}
+
+void writeConfig(MessageWriter &writer, const eSpeakPhonemeConfig &config) {
+    writer.str(config.voice);
+    for (Phoneme phoneme : {config.period, config.comma, config.question,
+                            config.exclamation, config.colon, config.semicolon,
+                            config.space}) {
+        writer.u32((uint32_t)phoneme);
+    }
+    writer.u32(config.keepLanguageFlags ? 1 : 0);
+}
+
+eSpeakPhonemeConfig readConfig(MessageReader &reader) {
+    eSpeakPhonemeConfig config;
+    config.voice = reader.str();
+    for (Phoneme *phoneme : {&config.period, &config.comma, &config.question,
+                             &config.exclamation, &config.colon, &config.semicolon,
+                             &config.space}) {
+        *phoneme = (Phoneme)reader.u32();
+    }
+    config.keepLanguageFlags = (reader.u32() != 0);
+    return config;
+}
+
+bool sendAll(int fd, const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void *data, size_t size) {
+    char *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        size -= (size_t)received;
+    }
+    return true;
+}
+
+// Dies with the process that forked it, and leaves Ctrl-C handling to the
+// pool's owner
+void followParent(pid_t parent) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != parent) {
+        _exit(1);
+    }
+    std::signal(SIGINT, SIG_IGN);
+}
+
+// Body of a helper process: serves requests until QuitMessage
+[[noreturn]] void workerMain(Ring &requests, Ring &responses,
+                             const std::string &espeakDataPath) {
+    try {
+        initializeESpeak(espeakDataPath);
+        while (true) {
+            std::string message = receiveMessage(requests);
+            MessageReader reader(message);
+            uint32_t kind = reader.u32();
+            if (kind == QuitMessage) {
+                break;
+            }
+
+            MessageWriter response;
+            try {
+                eSpeakPhonemeConfig config = readConfig(reader);
+                std::string text = reader.str();
+
+                std::vector<std::vector<int64_t>> sequences;
+                if (kind == SequenceMessage) {
+                    sequences.push_back(text_to_sequence(text, config));
+                } else {
+                    phonemize_eSpeak_clauses(text, config, [&](PhonemeClause &clause) {
+                        if (!clause.phonemes.empty()) {
+                            sequences.push_back(
+                                phonemes_to_sequence(clause_phonemes(clause, config)));
+                        }
+                        return true;
+                    });
+                }
+
+                response.u32(0);
+                response.u32((uint32_t)sequences.size());
+                for (const std::vector<int64_t> &sequence : sequences) {
+                    response.u32((uint32_t)sequence.size());
+                    for (int64_t id : sequence) {
+                        response.i64(id);
+                    }
+                }
+            } catch (const std::exception &e) {
+                response = MessageWriter();
+                response.u32(1);
+                response.str(e.what());
+            }
+            sendMessage(responses, response.bytes());
+        }
+    } catch (...) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+} // namespace
+
+struct PhonemizerPool::Worker {
+    uint32_t index = 0;
+    void *shared = MAP_FAILED;
+    size_t sharedBytes = 0;
+    Ring requests;
+    Ring responses;
+    pid_t pid = -1;
+
+    // Voice the helper last set, so callers can avoid switching it
+    std::string voice;
+};
+
+PhonemizerPool::PhonemizerPool(PhonemizerPoolConfig config) : m_config(config) {
+    if (m_config.numWorkers == 0) {
+        throw std::invalid_argument("PhonemizerPool needs at least one worker");
+    }
+    if (m_config.ringBytes < 64) {
+        throw std::invalid_argument("PhonemizerPool ringBytes is too small");
+    }
+
+    for (size_t i = 0; i < m_config.numWorkers; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->index = (uint32_t)i;
+        worker->sharedBytes = 2 * Ring::bytesNeeded(m_config.ringBytes);
+        worker->shared = mmap(nullptr, worker->sharedBytes, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (worker->shared == MAP_FAILED) {
+            throw std::runtime_error("Failed to map phonemizer ring buffers");
+        }
+        char *memory = static_cast<char *>(worker->shared);
+        worker->requests.attach(memory, m_config.ringBytes);
+        worker->responses.attach(memory + Ring::bytesNeeded(m_config.ringBytes),
+                                 m_config.ringBytes);
+        m_workers.push_back(std::move(worker));
+    }
+
+    // The zygote is forked after the rings are mapped, so it and every
+    // helper it forks share them, and while the caller is (ideally) still
+    // single-threaded
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+        throw std::runtime_error("Failed to create phonemizer zygote socket");
+    }
+    pid_t parent = getpid();
+    m_zygote = fork();
+    if (m_zygote < 0) {
+        close(sockets[0]);
+        close(sockets[1]);
+        throw std::runtime_error("Failed to fork phonemizer zygote");
+    }
+    if (m_zygote == 0) {
+        close(sockets[0]);
+        followParent(parent);
+        zygoteMain(sockets[1]);
+    }
+    close(sockets[1]);
+    m_zygoteControl = sockets[0];
+
+    for (std::unique_ptr<Worker> &worker : m_workers) {
+        spawn(*worker);
+        m_free.push_back(worker.get());
+    }
+}
+
+PhonemizerPool::~PhonemizerPool() {
+    for (std::unique_ptr<Worker> &worker : m_workers) {
+        stop(*worker);
+    }
+    // The zygote waits for the helpers to quit before it exits
+    if (m_zygote > 0) {
+        close(m_zygoteControl);
+        waitpid(m_zygote, nullptr, 0);
+    }
+    for (std::unique_ptr<Worker> &worker : m_workers) {
+        if (worker->shared != MAP_FAILED) {
+            munmap(worker->shared, worker->sharedBytes);
+        }
+    }
+}
+
+// Body of the zygote process: forks a helper for every worker index it is
+// sent until the pool closes the socket
+void PhonemizerPool::zygoteMain(int control) {
+    // Helpers are reaped as soon as they exit
+    std::signal(SIGCHLD, SIG_IGN);
+    pid_t zygote = getpid();
+    uint32_t index = 0;
+    while (receiveAll(control, &index, sizeof(index))) {
+        pid_t pid = -1;
+        if (index < m_workers.size()) {
+            pid = fork();
+            if (pid == 0) {
+                close(control);
+                std::signal(SIGCHLD, SIG_DFL);
+                followParent(zygote);
+                Worker &worker = *m_workers[index];
+                workerMain(worker.requests, worker.responses, m_config.espeakDataPath);
+            }
+        }
+        if (!sendAll(control, &pid, sizeof(pid))) {
+            break;
+        }
+    }
+    // With SIGCHLD ignored, wait() returns once every helper has exited
+    while (wait(nullptr) > 0 || errno == EINTR) {
+    }
+    _exit(0);
+}
+
+void PhonemizerPool::spawn(Worker &worker) {
+    worker.requests.reset();
+    worker.responses.reset();
+    worker.requests.setPeer(0);
+    worker.responses.setPeer(0);
+    worker.voice.clear();
+
+    pid_t pid = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_spawnMutex);
+        if (!sendAll(m_zygoteControl, &worker.index, sizeof(worker.index)) ||
+            !receiveAll(m_zygoteControl, &pid, sizeof(pid))) {
+            throw std::runtime_error("Phonemizer zygote exited");
+        }
+    }
+    if (pid < 0) {
+        throw std::runtime_error("Failed to fork phonemizer worker");
+    }
+
+    worker.pid = pid;
+    worker.requests.setPeer(pid);
+    worker.responses.setPeer(pid);
+}
+
+// The helper is the zygote's child, so it is reaped there rather than here
+void PhonemizerPool::stop(Worker &worker) {
+    if (worker.pid <= 0) {
+        return;
+    }
+    try {
+        MessageWriter quit;
+        quit.u32(QuitMessage);
+        sendMessage(worker.requests, quit.bytes());
+    } catch (const WorkerExited &) {
+    }
+    worker.pid = -1;
+}
+
+PhonemizerPool::Worker *PhonemizerPool::acquire(const std::string &voice) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_released.wait(lock, [this]() { return !m_free.empty(); });
+
+    // Any free helper will do, but one that already has the voice saves
+    // espeak-ng from loading it again
+    auto match = std::find_if(m_free.begin(), m_free.end(),
+                              [&voice](Worker *worker) { return worker->voice == voice; });
+    if (match == m_free.end()) {
+        match = std::prev(m_free.end());
+    }
+    Worker *worker = *match;
+    m_free.erase(match);
+    return worker;
+}
+
+void PhonemizerPool::release(Worker *worker) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(worker);
+    }
+    m_released.notify_one();
+}
+
+std::vector<std::vector<int64_t>> PhonemizerPool::call(uint32_t kind,
+                                                       const std::string &text,
+                                                       const eSpeakPhonemeConfig &config) {
+    StageTimer timer(Stage::Phonemize);
+
+    MessageWriter request;
+    request.u32(kind);
+    writeConfig(request, config);
+    request.str(text);
+
+    std::string response;
+    Worker *worker = acquire(config.voice);
+    try {
+        if (worker->pid <= 0) {
+            spawn(*worker);
+        }
+        sendMessage(worker->requests, request.bytes());
+        response = receiveMessage(worker->responses);
+        worker->voice = config.voice;
+    } catch (const WorkerExited &e) {
+        // Forked again on its next use
+        worker->pid = -1;
+        release(worker);
+        throw std::runtime_error(e.what());
+    } catch (...) {
+        release(worker);
+        throw;
+    }
+    release(worker);
+
+    MessageReader reader(response);
+    if (reader.u32() != 0) {
+        throw std::runtime_error("Phonemizer worker failed: " + reader.str());
+    }
+    std::vector<std::vector<int64_t>> sequences(reader.u32());
+    for (std::vector<int64_t> &sequence : sequences) {
+        sequence.resize(reader.u32());
+        for (int64_t &id : sequence) {
+            id = reader.i64();
+        }
+    }
+    return sequences;
+}
+
+std::vector<int64_t> PhonemizerPool::textToSequence(const std::string &text,
+                                                    const eSpeakPhonemeConfig &config) {
+    std::vector<std::vector<int64_t>> sequences = call(SequenceMessage, text, config);
+    if (sequences.size() != 1) {
+        throw std::runtime_error("Invalid phonemizer response");
+    }
+    return std::move(sequences.front());
+}
+
+std::vector<std::vector<int64_t>>
+PhonemizerPool::clauseSequences(const std::string &text, const eSpeakPhonemeConfig &config) {
+    return call(ClausesMessage, text, config);
+}
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "resampler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VITS_X86 1
+#include <immintrin.h>
+#endif
+
+// Sinc zero crossings on each side of the center, at the lower of the two
+// rates; more gives a steeper cutoff for longer phases
+static const int ZERO_CROSSINGS = 16;
+
+// Cutoff relative to the lower Nyquist frequency
+static const double ROLLOFF = 0.92;
+
+static const double KAISER_BETA = 8.0;
+
+// Phases are padded to a multiple of the widest kernel
+static const int TAP_ALIGN = 8;
+
+// Rate pairs needing more phases than this (e.g. 22050 -> 44101) are
+// rejected rather than building a huge bank
+static const int64_t MAX_PHASES = 2048;
+
+struct ResamplerFilter {
+  int64_t up;   // L
+  int64_t down; // M
+  int taps;     // per phase, multiple of TAP_ALIGN
+
+  // Filter delay in units of 1/L input samples
+  int64_t delay;
+
+  // Phase p occupies bank[p * taps, (p + 1) * taps), reversed so it is
+  // dotted with input in ascending order
+  std::vector<float> bank;
+};
+
+typedef float (*DotKernel)(const float *, const float *, int);
+
+static float dotScalar(const float *a, const float *b, int count) {
+    float sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#ifdef VITS_X86
+static float dotSse2(const float *a, const float *b, int count) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum) + dotScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float dotAvx2(const float *a, const float *b, int count) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    if (i + 8 <= count) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        i += 8;
+    }
+    __m256 sum8 = _mm256_add_ps(sum0, sum1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum) + dotScalar(a + i, b + i, count - i);
+}
+#endif // VITS_X86
+
+struct ResamplerKernels {
+    DotKernel dot;
+    const char *name;
+};
+
+static ResamplerKernels selectKernels() {
+#ifdef VITS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {dotAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {dotSse2, "sse2"};
+    }
+#endif
+    return {dotScalar, "scalar"};
+}
+
+static const ResamplerKernels &kernels() {
+    static const ResamplerKernels selected = selectKernels();
+    return selected;
+}
+
+const char *resamplerKernelName() {
+    return kernels().name;
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser
+// window
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static std::shared_ptr<const ResamplerFilter> buildFilter(int64_t up, int64_t down) {
+    auto filter = std::make_shared<ResamplerFilter>();
+    filter->up = up;
+    filter->down = down;
+
+    // Downsampling needs proportionally longer phases to keep the same
+    // number of zero crossings at the (lower) output rate
+    double widest = (double)std::max(up, down) / (double)up;
+    int taps = (int)std::ceil(2.0 * ZERO_CROSSINGS * widest);
+    taps = (taps + TAP_ALIGN - 1) / TAP_ALIGN * TAP_ALIGN;
+    filter->taps = taps;
+
+    // Prototype low-pass at L times the input rate
+    int64_t length = up * taps;
+    filter->delay = length / 2;
+    double cutoff = ROLLOFF * 0.5 / (double)std::max(up, down);
+    double windowNorm = besselI0(KAISER_BETA);
+    std::vector<double> prototype(length);
+    for (int64_t j = 0; j < length; j++) {
+        double offset = (double)(j - filter->delay);
+        double x = 2.0 * cutoff * offset;
+        double sinc = (offset == 0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+        double position = offset / (double)filter->delay;
+        double window =
+            besselI0(KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - position * position))) /
+            windowNorm;
+        prototype[j] = sinc * window;
+    }
+
+    // Each phase is normalized to unity gain, so DC passes through exactly
+    // whichever phase produces a sample
+    filter->bank.assign((size_t)length, 0.0f);
+    for (int64_t p = 0; p < up; p++) {
+        double sum = 0;
+        for (int i = 0; i < taps; i++) {
+            sum += prototype[p + i * up];
+        }
+        float *phase = filter->bank.data() + p * taps;
+        for (int i = 0; i < taps; i++) {
+            phase[taps - 1 - i] = (float)(prototype[p + i * up] / sum);
+        }
+    }
+    return filter;
+}
+
+// Banks are shared by every resampler for the same ratio
+static std::shared_ptr<const ResamplerFilter> filterFor(int64_t up, int64_t down) {
+    static std::mutex mutex;
+    static std::map<std::pair<int64_t, int64_t>, std::shared_ptr<const ResamplerFilter>> filters;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const ResamplerFilter> &filter = filters[{up, down}];
+    if (!filter) {
+        filter = buildFilter(up, down);
+    }
+    return filter;
+}
+
+Resampler::Resampler(int inputRate, int outputRate)
+    : m_inputRate(inputRate), m_outputRate(outputRate) {
+    if (inputRate <= 0 || outputRate <= 0) {
+        throw std::invalid_argument("Sample rates must be positive");
+    }
+    if (passthrough()) {
+        return;
+    }
+    int64_t divisor = std::gcd((int64_t)inputRate, (int64_t)outputRate);
+    int64_t up = outputRate / divisor;
+    int64_t down = inputRate / divisor;
+    if (up > MAX_PHASES) {
+        throw std::invalid_argument("Unsupported resampling ratio " +
+                                    std::to_string(inputRate) + " -> " +
+                                    std::to_string(outputRate));
+    }
+    m_filter = filterFor(up, down);
+    reset();
+}
+
+void Resampler::reset() {
+    m_inputSamples = 0;
+    m_outputSamples = 0;
+    if (!m_filter) {
+        return;
+    }
+    // Silence before the first sample fills the taps of the first outputs
+    m_history.assign(m_filter->taps - 1, 0.0f);
+    m_historyStart = -(int64_t)(m_filter->taps - 1);
+}
+
+void Resampler::process(const int16_t *samples, size_t numSamples,
+                        std::vector<int16_t> &out) {
+    if (passthrough()) {
+        out.insert(out.end(), samples, samples + numSamples);
+        return;
+    }
+    const ResamplerFilter &filter = *m_filter;
+    DotKernel dot = kernels().dot;
+
+    m_history.insert(m_history.end(), samples, samples + numSamples);
+    m_inputSamples += numSamples;
+
+    // Output n sits at n * M + delay on the L-times grid; it needs input up
+    // to (n * M + delay) / L
+    const int64_t available = m_historyStart + (int64_t)m_history.size();
+    while (true) {
+        int64_t position = (int64_t)m_outputSamples * filter.down + filter.delay;
+        int64_t last = position / filter.up;
+        if (last >= available) {
+            break;
+        }
+        int64_t phase = position % filter.up;
+        const float *input = m_history.data() + (last - (filter.taps - 1) - m_historyStart);
+        float value = dot(filter.bank.data() + phase * filter.taps, input, filter.taps);
+        out.push_back((int16_t)std::lrint(std::clamp(value, -32768.0f, 32767.0f)));
+        m_outputSamples++;
+    }
+
+    // Keep only what the next output still needs
+    int64_t nextLast = ((int64_t)m_outputSamples * filter.down + filter.delay) / filter.up;
+    int64_t keepFrom = std::min(nextLast - (filter.taps - 1), available);
+    if (keepFrom > m_historyStart) {
+        m_history.erase(m_history.begin(), m_history.begin() + (keepFrom - m_historyStart));
+        m_historyStart = keepFrom;
+    }
+}
+
+void Resampler::flush(std::vector<int16_t> &out) {
+    if (passthrough()) {
+        return;
+    }
+    const ResamplerFilter &filter = *m_filter;
+    uint64_t total = (m_inputSamples * filter.up + filter.down - 1) / filter.down;
+    if (m_outputSamples < total) {
+        // Pad with silence until the last output's taps are covered, then
+        // drop whatever the padding produced past the end
+        int64_t last = ((int64_t)(total - 1) * filter.down + filter.delay) / filter.up;
+        int64_t available = m_historyStart + (int64_t)m_history.size();
+        std::vector<int16_t> silence((size_t)std::max<int64_t>(0, last + 1 - available), 0);
+        process(silence.data(), silence.size(), out);
+        out.resize(out.size() - (m_outputSamples - total));
+    }
+    reset();
+}
+
+void resampleAudio(std::vector<int16_t> &audio, int inputRate, int outputRate) {
+    if (inputRate == outputRate) {
+        return;
+    }
+    Resampler resampler(inputRate, outputRate);
+    std::vector<int16_t> resampled;
+    resampled.reserve((size_t)((double)audio.size() * outputRate / inputRate) + 1);
+    resampler.process(audio.data(), audio.size(), resampled);
+    resampler.flush(resampled);
+    audio.swap(resampled);
+}
@@ -0,0 +1,141 @@
+#include <chrono>
+#include <stdexcept>
+
+#include "session_pool.h"
+#include "metrics.h"
+#include "silence.h"
+
+SessionPool::SessionPool(const std::string &modelPath, SessionPoolConfig config)
+    : m_config(config),
+      m_env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "vits"),
+      m_memoryInfo(Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator,
+                                              OrtMemType::OrtMemTypeDefault)) {
+    if (m_config.numWorkers == 0) {
+        throw std::invalid_argument("SessionPool needs at least one worker");
+    }
+    m_env.DisableTelemetryEvents();
+    auto startTime = std::chrono::steady_clock::now();
+
+    // One CPU arena for every session instead of one per session
+    Ort::ArenaCfg arenaConfig(0, -1, -1, -1);
+    m_env.CreateAndRegisterAllocator(m_memoryInfo, arenaConfig);
+
+    SessionTuning tuning;
+    loadSessionTuning(defaultTuningPath(modelPath), tuning);
+
+    size_t numSessions =
+        (m_config.mode == SessionPoolMode::SharedSession) ? 1 : m_config.numWorkers;
+    for (size_t i = 0; i < numSessions; i++) {
+        auto session = std::make_unique<ModelSession>();
+        session->tuning = tuning;
+        session->memoryBudget = m_config.memoryBudget;
+        configureSession(*session, m_config.useCuda);
+        if (m_config.intraOpThreads > 0) {
+            session->options.SetIntraOpNumThreads(m_config.intraOpThreads);
+        }
+        session->options.AddConfigEntry("session.use_env_allocators", "1");
+        if (m_config.coldStart) {
+            // The first session saves the optimized model, the rest load it
+            ColdStartStats stats;
+            createSessionCached(modelPath, *session, m_env, m_config.useCuda,
+                                *m_config.coldStart, stats);
+            if (i == 0) {
+                m_coldStartStats = stats;
+            }
+        } else {
+            createSession(modelPath, *session, m_env);
+        }
+        m_sessions.push_back(std::move(session));
+    }
+
+    // A shared session appears once per worker so acquire() still bounds
+    // the number of concurrent Run calls
+    for (size_t i = 0; i < m_config.numWorkers; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->session = m_sessions[i % m_sessions.size()].get();
+        worker->bound = std::make_unique<BoundInference>(*worker->session);
+        m_free.push_back(worker.get());
+        m_workers.push_back(std::move(worker));
+    }
+
+    if (m_config.coldStart) {
+        auto warmupStart = std::chrono::steady_clock::now();
+        for (std::unique_ptr<Worker> &worker : m_workers) {
+            warmUp(*worker);
+        }
+        auto endTime = std::chrono::steady_clock::now();
+        m_coldStartStats.warmupSeconds =
+            std::chrono::duration<double>(endTime - warmupStart).count();
+        m_coldStartStats.coldStartSeconds =
+            std::chrono::duration<double>(endTime - startTime).count();
+        metrics().recordColdStart(m_coldStartStats);
+    }
+}
+
+void SessionPool::warmUp(Worker &worker) {
+    SynthesisConfig synthesisConfig;
+    for (size_t length : m_config.coldStart->warmupLengths) {
+        std::vector<int64_t> phonemeIds = warmupSequence(length);
+        SynthesisResult result;
+        if (m_config.useIoBinding) {
+            worker.bound->run(phonemeIds.data(), phonemeIds.size(),
+                              synthesisConfig, result);
+        } else {
+            std::vector<int16_t> audioBuffer;
+            Synthesize(phonemeIds, synthesisConfig, *worker.session, audioBuffer, result);
+        }
+    }
+}
+
+SessionPool::Lease::Lease(Lease &&other) noexcept
+    : m_pool(other.m_pool), m_worker(other.m_worker) {
+    other.m_pool = nullptr;
+    other.m_worker = nullptr;
+}
+
+SessionPool::Lease::~Lease() {
+    if (m_pool) {
+        m_pool->release(m_worker);
+    }
+}
+
+SessionPool::Lease SessionPool::acquire() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free.empty()) {
+        metrics().queueDepth.add(1);
+        m_released.wait(lock, [this]() { return !m_free.empty(); });
+        metrics().queueDepth.add(-1);
+    }
+    Worker *worker = m_free.back();
+    m_free.pop_back();
+    return Lease(this, worker);
+}
+
+void SessionPool::release(Worker *worker) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(worker);
+    }
+    m_released.notify_one();
+}
+
+void SessionPool::synthesize(std::vector<int64_t> &phonemeIds,
+                             SynthesisConfig &synthesisConfig,
+                             std::vector<int16_t> &audioBuffer,
+                             SynthesisResult &result) {
+    Lease lease = acquire();
+    if (m_config.useIoBinding) {
+        BoundInference &bound = lease.boundInference();
+        audioBuffer.clear();
+        appendDecodedClauses(
+            phonemeIds, synthesisConfig,
+            maxIdsPerRun(lease.session(), synthesisConfig),
+            [&](const int64_t *ids, size_t numIds, size_t &numSamples,
+                SynthesisResult &clauseResult) {
+                return bound.decode(ids, numIds, synthesisConfig, clauseResult, numSamples);
+            },
+            audioBuffer, result);
+        return;
+    }
+    SynthesizeClauses(phonemeIds, synthesisConfig, lease.session(), audioBuffer, result);
+}
@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include "session_tuning.h"
+#include "vits_onnx.h"
+
+static const char *optimizationLevelName(GraphOptimizationLevel level) {
+    switch (level) {
+    case GraphOptimizationLevel::ORT_DISABLE_ALL:
+        return "disable_all";
+    case GraphOptimizationLevel::ORT_ENABLE_BASIC:
+        return "basic";
+    case GraphOptimizationLevel::ORT_ENABLE_EXTENDED:
+        return "extended";
+    default:
+        return "all";
+    }
+}
+
+static GraphOptimizationLevel parseOptimizationLevel(const std::string &value) {
+    if (value == "disable_all") {
+        return GraphOptimizationLevel::ORT_DISABLE_ALL;
+    } else if (value == "basic") {
+        return GraphOptimizationLevel::ORT_ENABLE_BASIC;
+    } else if (value == "extended") {
+        return GraphOptimizationLevel::ORT_ENABLE_EXTENDED;
+    } else if (value == "all") {
+        return GraphOptimizationLevel::ORT_ENABLE_ALL;
+    }
+    throw std::runtime_error("Unknown graph_optimization_level: " + value);
+}
+
+static const char *executionModeName(ExecutionMode mode) {
+    return (mode == ExecutionMode::ORT_PARALLEL) ? "parallel" : "sequential";
+}
+
+static ExecutionMode parseExecutionMode(const std::string &value) {
+    if (value == "sequential") {
+        return ExecutionMode::ORT_SEQUENTIAL;
+    } else if (value == "parallel") {
+        return ExecutionMode::ORT_PARALLEL;
+    }
+    throw std::runtime_error("Unknown execution_mode: " + value);
+}
+
+static std::string bucketsName(const std::vector<int64_t> &buckets) {
+    if (buckets.empty()) {
+        return "off";
+    }
+    std::string name;
+    for (int64_t bucket : buckets) {
+        name += (name.empty() ? "" : ",") + std::to_string(bucket);
+    }
+    return name;
+}
+
+static std::vector<int64_t> parseBuckets(const std::string &value) {
+    std::vector<int64_t> buckets;
+    if (value == "off") {
+        return buckets;
+    }
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t comma = std::min(value.find(',', start), value.size());
+        std::string token = value.substr(start, comma - start);
+        start = comma + 1;
+        // Tolerate "128,256," and "128,,256" from hand edits
+        if (token.find_first_not_of(" \t") == std::string::npos) {
+            continue;
+        }
+        int64_t bucket = std::stoll(token);
+        if (bucket <= 0 || (!buckets.empty() && bucket <= buckets.back())) {
+            throw std::runtime_error("length_buckets must be positive and ascending: " + value);
+        }
+        buckets.push_back(bucket);
+    }
+    return buckets;
+}
+
+bool loadSessionTuning(const std::string &path, SessionTuning &tuning) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            throw std::runtime_error("Malformed line in " + path + ": " + line);
+        }
+        std::string key = line.substr(0, equals);
+        std::string value = line.substr(equals + 1);
+
+        try {
+            if (key == "graph_optimization_level") {
+                tuning.graphOptimizationLevel = parseOptimizationLevel(value);
+            } else if (key == "intra_op_threads") {
+                tuning.intraOpThreads = std::stoi(value);
+            } else if (key == "inter_op_threads") {
+                tuning.interOpThreads = std::stoi(value);
+            } else if (key == "execution_mode") {
+                tuning.executionMode = parseExecutionMode(value);
+            } else if (key == "cpu_mem_arena") {
+                tuning.cpuMemArena = (value == "1");
+            } else if (key == "mem_pattern") {
+                tuning.memPattern = (value == "1");
+            } else if (key == "length_buckets") {
+                tuning.lengthBuckets = parseBuckets(value);
+            }
+        } catch (const std::exception &e) {
+            throw std::runtime_error("Bad " + key + " in " + path + ": " + e.what());
+        }
+        // Unknown keys are ignored so older builds can read newer files
+    }
+    return true;
+}
+
+void saveSessionTuning(const std::string &path, const SessionTuning &tuning) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Failed to write session tuning: " + path);
+    }
+    file << "# Written by vits_autotune\n"
+         << "graph_optimization_level="
+         << optimizationLevelName(tuning.graphOptimizationLevel) << "\n"
+         << "intra_op_threads=" << tuning.intraOpThreads << "\n"
+         << "inter_op_threads=" << tuning.interOpThreads << "\n"
+         << "execution_mode=" << executionModeName(tuning.executionMode) << "\n"
+         << "cpu_mem_arena=" << (tuning.cpuMemArena ? 1 : 0) << "\n"
+         << "mem_pattern=" << (tuning.memPattern ? 1 : 0) << "\n"
+         << "length_buckets=" << bucketsName(tuning.lengthBuckets) << "\n";
+}
+
+std::string describeSessionTuning(const SessionTuning &tuning) {
+    return std::string("opt=") + optimizationLevelName(tuning.graphOptimizationLevel) +
+           " intra=" + std::to_string(tuning.intraOpThreads) +
+           " inter=" + std::to_string(tuning.interOpThreads) +
+           " mode=" + executionModeName(tuning.executionMode) +
+           " arena=" + (tuning.cpuMemArena ? "1" : "0") +
+           " pattern=" + (tuning.memPattern ? "1" : "0") +
+           " buckets=" + bucketsName(tuning.lengthBuckets);
+}
+
+const std::vector<int64_t> &defaultLengthBuckets() {
+    static const std::vector<int64_t> buckets{32, 64, 128, 256, 512};
+    return buckets;
+}
+
+int64_t bucketLength(const SessionTuning &tuning, int64_t length) {
+    auto bucket = std::lower_bound(tuning.lengthBuckets.begin(),
+                                   tuning.lengthBuckets.end(), length);
+    return (bucket == tuning.lengthBuckets.end()) ? length : *bucket;
+}
+
+std::string defaultTuningPath(const std::string &modelPath) {
+    return modelPath + ".tuning";
+}
+
+static AutotuneMeasurement measure(const std::string &modelPath,
+                                   const std::vector<std::vector<int64_t>> &corpus,
+                                   const AutotuneOptions &options,
+                                   const SessionTuning &tuning) {
+    AutotuneMeasurement measurement;
+    measurement.tuning = tuning;
+
+    ModelSession session;
+    session.tuning = tuning;
+    auto startTime = std::chrono::steady_clock::now();
+    loadModel(modelPath, session, options.useCuda);
+    auto endTime = std::chrono::steady_clock::now();
+    measurement.loadSeconds = std::chrono::duration<double>(endTime - startTime).count();
+
+    SynthesisConfig config;
+    std::vector<int16_t> audio;
+
+    // Warm-up so one-time allocations and lazy kernel setup aren't timed
+    for (const std::vector<int64_t> &ids : corpus) {
+        std::vector<int64_t> phonemeIds = ids;
+        SynthesisResult result;
+        audio.clear();
+        Synthesize(phonemeIds, config, session, audio, result);
+    }
+
+    for (int r = 0; r < options.repeats; r++) {
+        for (const std::vector<int64_t> &ids : corpus) {
+            std::vector<int64_t> phonemeIds = ids;
+            SynthesisResult result;
+            audio.clear();
+            Synthesize(phonemeIds, config, session, audio, result);
+            measurement.inferSeconds += result.inferSeconds;
+            measurement.audioSeconds += result.audioSeconds;
+        }
+    }
+    if (measurement.audioSeconds > 0) {
+        measurement.realTimeFactor = measurement.inferSeconds / measurement.audioSeconds;
+    }
+    return measurement;
+}
+
+SessionTuning autotuneSession(const std::string &modelPath,
+                              const std::vector<std::vector<int64_t>> &corpus,
+                              const AutotuneOptions &options,
+                              std::vector<AutotuneMeasurement> &measurements) {
+    if (corpus.empty()) {
+        throw std::invalid_argument("autotuneSession needs a non-empty corpus");
+    }
+
+    int maxThreads = options.maxThreads;
+    if (maxThreads <= 0) {
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<int> threadCounts{0};
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    if (threadCounts.back() != maxThreads) {
+        threadCounts.push_back(maxThreads);
+    }
+
+    SessionTuning best;
+    measurements.push_back(measure(modelPath, corpus, options, best));
+    double bestRtf = measurements.back().realTimeFactor;
+
+    // Tries each value of one setting on top of the best tuning so far
+    auto sweep = [&](auto values, auto apply) {
+        for (auto value : values) {
+            SessionTuning candidate = best;
+            apply(candidate, value);
+            if (describeSessionTuning(candidate) == describeSessionTuning(best)) {
+                continue;
+            }
+            measurements.push_back(measure(modelPath, corpus, options, candidate));
+            if (measurements.back().realTimeFactor < bestRtf) {
+                bestRtf = measurements.back().realTimeFactor;
+                best = candidate;
+            }
+        }
+    };
+
+    sweep(std::vector<GraphOptimizationLevel>{GraphOptimizationLevel::ORT_DISABLE_ALL,
+                                              GraphOptimizationLevel::ORT_ENABLE_BASIC,
+                                              GraphOptimizationLevel::ORT_ENABLE_EXTENDED,
+                                              GraphOptimizationLevel::ORT_ENABLE_ALL},
+          [](SessionTuning &t, GraphOptimizationLevel v) { t.graphOptimizationLevel = v; });
+    sweep(threadCounts, [](SessionTuning &t, int v) { t.intraOpThreads = v; });
+    sweep(std::vector<ExecutionMode>{ExecutionMode::ORT_SEQUENTIAL,
+                                     ExecutionMode::ORT_PARALLEL},
+          [](SessionTuning &t, ExecutionMode v) { t.executionMode = v; });
+
+    // Inter-op threads only matter when operators run in parallel
+    if (best.executionMode == ExecutionMode::ORT_PARALLEL) {
+        sweep(threadCounts, [](SessionTuning &t, int v) { t.interOpThreads = v; });
+    }
+    // The arena and memory pattern pay off with fixed shapes, which is what
+    // bucketing gives them, so buckets are measured with them already swept
+    // and then once more with all three enabled together
+    sweep(std::vector<bool>{false, true}, [](SessionTuning &t, bool v) { t.cpuMemArena = v; });
+    sweep(std::vector<bool>{false, true}, [](SessionTuning &t, bool v) { t.memPattern = v; });
+    sweep(std::vector<std::vector<int64_t>>{{}, defaultLengthBuckets()},
+          [](SessionTuning &t, const std::vector<int64_t> &v) { t.lengthBuckets = v; });
+    sweep(std::vector<bool>{true}, [](SessionTuning &t, bool) {
+        t.lengthBuckets = defaultLengthBuckets();
+        t.cpuMemArena = true;
+        t.memPattern = true;
+    });
+
+    return best;
+}
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cmath>
+
+#include "metrics.h"
+#include "silence.h"
+#include "symbols.h"
+
+// Energy is measured over frames of this length
+static const int FRAMES_PER_SECOND = 100;
+
+static Phoneme symbolOf(int64_t id) {
+    return (id >= 0 && (size_t)id < NUM_SYMBOLS) ? SYMBOLS[id] : 0;
+}
+
+static bool isSentenceEnd(Phoneme phoneme) {
+    return phoneme == U'.' || phoneme == U'?' || phoneme == U'!';
+}
+
+static bool isClauseEnd(Phoneme phoneme) {
+    return isSentenceEnd(phoneme) || phoneme == U',' || phoneme == U':' || phoneme == U';';
+}
+
+// Cuts an over-long clause into pieces of at most maxIds, preferring to cut
+// after a space
+static void splitLongClause(const std::vector<int64_t> &phonemeIds, const IdClause &clause,
+                            size_t maxIds, std::vector<IdClause> &clauses) {
+    size_t begin = clause.begin;
+    while (clause.end - begin > maxIds) {
+        size_t end = begin + maxIds;
+        while (end > begin + 1 && symbolOf(phonemeIds[end - 1]) != U' ') {
+            end--;
+        }
+        IdClause piece;
+        piece.begin = begin;
+        if (symbolOf(phonemeIds[end - 1]) == U' ') {
+            piece.end = end - 1;
+            piece.terminator = U' ';
+        } else {
+            end = begin + maxIds;
+            piece.end = end;
+        }
+        if (piece.end > piece.begin) {
+            clauses.push_back(piece);
+        }
+        begin = end;
+    }
+    IdClause rest = clause;
+    rest.begin = begin;
+    clauses.push_back(rest);
+}
+
+std::vector<IdClause> splitIdClauses(const std::vector<int64_t> &phonemeIds,
+                                     const SynthesisConfig &synthesisConfig,
+                                     size_t maxIds) {
+    const auto &phonemeSilence = synthesisConfig.phonemeSilenceSeconds;
+    std::vector<IdClause> clauses;
+    IdClause clause;
+    for (size_t i = 0; i < phonemeIds.size(); i++) {
+        int64_t id = phonemeIds[i];
+        Phoneme phoneme = symbolOf(id);
+        bool boundary = isClauseEnd(phoneme) ||
+                        (phonemeSilence && phonemeSilence->count(phoneme) > 0);
+        if (!boundary) {
+            continue;
+        }
+        // Repeated punctuation ("...", "!!") closes a single clause
+        while (i + 1 < phonemeIds.size() && phonemeIds[i + 1] == id) {
+            i++;
+        }
+        clause.end = i + 1;
+        clause.terminator = phoneme;
+        splitLongClause(phonemeIds, clause, maxIds, clauses);
+        clause = IdClause();
+
+        // Spaces between clauses are replaced by the inserted pause
+        while (i + 1 < phonemeIds.size() && symbolOf(phonemeIds[i + 1]) == U' ') {
+            i++;
+        }
+        clause.begin = i + 1;
+    }
+    if (clause.begin < phonemeIds.size()) {
+        clause.end = phonemeIds.size();
+        splitLongClause(phonemeIds, clause, maxIds, clauses);
+    }
+    return clauses;
+}
+
+size_t clauseSilenceSamples(Phoneme terminator, const SynthesisConfig &synthesisConfig) {
+    float seconds = isSentenceEnd(terminator) ? synthesisConfig.sentenceSilenceSeconds : 0.0f;
+    const auto &phonemeSilence = synthesisConfig.phonemeSilenceSeconds;
+    if (phonemeSilence) {
+        auto found = phonemeSilence->find(terminator);
+        if (found != phonemeSilence->end()) {
+            seconds = found->second;
+        }
+    }
+    if (seconds <= 0) {
+        return 0;
+    }
+    return (size_t)std::lround(seconds * (float)synthesisConfig.sampleRate) *
+           (size_t)synthesisConfig.channels;
+}
+
+// Sum of squares stays exact in 64 bits for any frame under ~8.5e9 samples
+static bool loudFrame(const int16_t *audio, size_t count, int64_t thresholdEnergy) {
+    int64_t energy = 0;
+    for (size_t i = 0; i < count; i++) {
+        energy += (int64_t)audio[i] * audio[i];
+    }
+    return energy > thresholdEnergy;
+}
+
+AudioSpan trimSilence(const int16_t *audio, size_t count,
+                      const SynthesisConfig &synthesisConfig) {
+    AudioSpan span;
+    span.end = count;
+    if (!synthesisConfig.trimSilence || count == 0) {
+        return span;
+    }
+
+    size_t frameLength = std::max<size_t>(
+        1, (size_t)(synthesisConfig.sampleRate * synthesisConfig.channels / FRAMES_PER_SECOND));
+    double threshold = 32767.0 * std::pow(10.0, synthesisConfig.trimThresholdDb / 20.0);
+    int64_t thresholdEnergy = (int64_t)(threshold * threshold * (double)frameLength);
+    size_t numFrames = (count + frameLength - 1) / frameLength;
+    auto frameSize = [&](size_t frame) {
+        return std::min(frameLength, count - frame * frameLength);
+    };
+
+    size_t first = 0;
+    while (first < numFrames &&
+           !loudFrame(audio + first * frameLength, frameSize(first), thresholdEnergy)) {
+        first++;
+    }
+    if (first == numFrames) {
+        span.end = 0;
+        return span;
+    }
+    size_t last = numFrames - 1;
+    while (last > first &&
+           !loudFrame(audio + last * frameLength, frameSize(last), thresholdEnergy)) {
+        last--;
+    }
+
+    first = (first > 0) ? first - 1 : 0;
+    last = std::min(last + 1, numFrames - 1);
+    span.begin = first * frameLength;
+    span.end = last * frameLength + frameSize(last);
+    return span;
+}
+
+void appendClauseAudio(const int16_t *audio, size_t count, Phoneme terminator,
+                       const SynthesisConfig &synthesisConfig,
+                       std::vector<int16_t> &audioBuffer) {
+    AudioSpan span = trimSilence(audio, count, synthesisConfig);
+    audioBuffer.insert(audioBuffer.end(), audio + span.begin, audio + span.end);
+    audioBuffer.resize(audioBuffer.size() + clauseSilenceSamples(terminator, synthesisConfig),
+                       0);
+}
+
+void appendClauses(const std::vector<int64_t> &phonemeIds,
+                   const SynthesisConfig &synthesisConfig, size_t maxIds,
+                   const ClauseSynthesizer &synthesizeClause,
+                   std::vector<int16_t> &audioBuffer, SynthesisResult &result) {
+    result = SynthesisResult();
+    size_t startSize = audioBuffer.size();
+    for (const IdClause &clause : splitIdClauses(phonemeIds, synthesisConfig, maxIds)) {
+        SynthesisResult clauseResult;
+        size_t numSamples = 0;
+        const int16_t *audio = synthesizeClause(phonemeIds.data() + clause.begin,
+                                                clause.end - clause.begin, numSamples,
+                                                clauseResult);
+        result.inferSeconds += clauseResult.inferSeconds;
+        result.longestRunIds = std::max(result.longestRunIds, clause.end - clause.begin);
+        appendClauseAudio(audio, numSamples, clause.terminator, synthesisConfig, audioBuffer);
+    }
+
+    result.audioSeconds = (double)(audioBuffer.size() - startSize) /
+                          (double)(synthesisConfig.sampleRate * synthesisConfig.channels);
+    if (result.audioSeconds > 0) {
+        result.realTimeFactor = result.inferSeconds / result.audioSeconds;
+    }
+}
+
+void appendDecodedClauses(const std::vector<int64_t> &phonemeIds,
+                          const SynthesisConfig &synthesisConfig, size_t maxIds,
+                          const ClauseDecoder &decodeClause,
+                          std::vector<int16_t> &audioBuffer, SynthesisResult &result) {
+    std::vector<int16_t> clauseAudio;
+    auto convertClause = [&](AudioConverter &converter, const float *audio, size_t count) {
+        StageTimer timer(Stage::Postprocess);
+        clauseAudio.resize(count);
+        converter.convert(audio, count, clauseAudio.data());
+        return (const int16_t *)clauseAudio.data();
+    };
+
+    if (synthesisConfig.gainMode != GainMode::Peak) {
+        AudioConverter converter(synthesisConfig.gainMode, synthesisConfig.fixedGain);
+        appendClauses(
+            phonemeIds, synthesisConfig, maxIds,
+            [&](const int64_t *ids, size_t numIds, size_t &numSamples,
+                SynthesisResult &clauseResult) {
+                const float *audio = decodeClause(ids, numIds, numSamples, clauseResult);
+                return convertClause(converter, audio, numSamples);
+            },
+            audioBuffer, result);
+        return;
+    }
+
+    // The gain needs the peak of every clause, so decode them all first.
+    // Trimming then sees the same levels as in one unsplit run.
+    std::vector<float> requestAudio;
+    std::vector<size_t> clauseEnds;
+    std::vector<SynthesisResult> clauseResults;
+    for (const IdClause &clause : splitIdClauses(phonemeIds, synthesisConfig, maxIds)) {
+        SynthesisResult clauseResult;
+        size_t numSamples = 0;
+        const float *audio = decodeClause(phonemeIds.data() + clause.begin,
+                                          clause.end - clause.begin, numSamples, clauseResult);
+        requestAudio.insert(requestAudio.end(), audio, audio + numSamples);
+        clauseEnds.push_back(requestAudio.size());
+        clauseResults.push_back(clauseResult);
+    }
+
+    AudioConverter converter(GainMode::Fixed,
+                             peakGain(findPeak(requestAudio.data(), requestAudio.size())));
+    size_t clauseIndex = 0;
+    appendClauses(
+        phonemeIds, synthesisConfig, maxIds,
+        [&](const int64_t *, size_t, size_t &numSamples, SynthesisResult &clauseResult) {
+            // Same split as above, so clauses come back in the same order
+            size_t begin = (clauseIndex > 0) ? clauseEnds[clauseIndex - 1] : 0;
+            numSamples = clauseEnds[clauseIndex] - begin;
+            clauseResult = clauseResults[clauseIndex++];
+            return convertClause(converter, requestAudio.data() + begin, numSamples);
+        },
+        audioBuffer, result);
+}
+
+void SynthesizeClauses(std::vector<int64_t> &phonemeIds,
+                       SynthesisConfig &synthesisConfig, ModelSession &session,
+                       std::vector<int16_t> &audioBuffer, SynthesisResult &result) {
+    std::vector<int64_t> clauseIds;
+    std::vector<float> clauseAudio;
+    appendDecodedClauses(
+        phonemeIds, synthesisConfig, maxIdsPerRun(session, synthesisConfig),
+        [&](const int64_t *ids, size_t numIds, size_t &numSamples,
+            SynthesisResult &clauseResult) {
+            clauseIds.assign(ids, ids + numIds);
+            clauseAudio.clear();
+            SynthesizeFloat(clauseIds, synthesisConfig, session, clauseAudio, clauseResult);
+            numSamples = clauseAudio.size();
+            return (const float *)clauseAudio.data();
+        },
+        audioBuffer, result);
+}
@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "synthesis_server.h"
+#include "logging.h"
+#include "metrics.h"
+#include "resampler.h"
+#include "silence.h"
+#include "wavfile.hpp"
+
+// Caps the request line plus headers
+const size_t MAX_HEADER_BYTES = 16 * 1024;
+
+// Slow or idle clients give up their worker after this long, whether the
+// worker is waiting for their request or for room to send them audio
+const int RECEIVE_TIMEOUT_SECONDS = 10;
+const int SEND_TIMEOUT_SECONDS = 10;
+
+// True if path exists and is a socket (not following symlinks)
+static bool isSocketFile(const std::string &path) {
+    struct stat status;
+    return lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode);
+}
+
+static bool sendAll(int fd, const void *data, size_t length) {
+    const char *bytes = (const char *)data;
+    while (length > 0) {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool sendChunk(int fd, const void *data, size_t length) {
+    if (length == 0) {
+        // A zero-size chunk would end the response
+        return true;
+    }
+    char size[32];
+    int sizeLength = std::snprintf(size, sizeof(size), "%zx\r\n", length);
+    return sendAll(fd, size, (size_t)sizeLength) && sendAll(fd, data, length) &&
+           sendAll(fd, "\r\n", 2);
+}
+
+static void sendResponse(int fd, const std::string &status,
+                         const std::string &contentType, const std::string &body) {
+    std::string response = "HTTP/1.1 " + status + "\r\n" +
+                           "Content-Type: " + contentType + "\r\n" +
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                           "Connection: close\r\n\r\n" + body;
+    sendAll(fd, response.data(), response.size());
+}
+
+static std::string percentDecode(const std::string &value) {
+    std::string decoded;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '+') {
+            decoded += ' ';
+        } else if (value[i] == '%' && i + 2 < value.size() &&
+                   std::isxdigit((unsigned char)value[i + 1]) &&
+                   std::isxdigit((unsigned char)value[i + 2])) {
+            decoded += (char)std::stoi(value.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        } else {
+            decoded += value[i];
+        }
+    }
+    return decoded;
+}
+
+static std::map<std::string, std::string> parseQuery(const std::string &query) {
+    std::map<std::string, std::string> params;
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        std::string pair = query.substr(start, end - start);
+        size_t equals = pair.find('=');
+        if (equals == std::string::npos) {
+            params[percentDecode(pair)] = "";
+        } else {
+            params[percentDecode(pair.substr(0, equals))] =
+                percentDecode(pair.substr(equals + 1));
+        }
+        start = end + 1;
+    }
+    return params;
+}
+
+SynthesisServer::SynthesisServer(SynthesisServerConfig config)
+    : m_config(std::move(config)) {
+    if (m_config.numWorkers == 0) {
+        throw std::invalid_argument("SynthesisServer needs at least one worker");
+    }
+    if (m_config.unixSocketPath.empty() && m_config.tcpPort < 0) {
+        throw std::invalid_argument("SynthesisServer needs a Unix socket or a TCP port");
+    }
+
+    initializeESpeak(m_config.espeakDataPath);
+    if (m_config.phonemizerWorkers > 0) {
+        // Forked before the session pool starts any onnxruntime threads
+        PhonemizerPoolConfig phonemizerConfig;
+        phonemizerConfig.numWorkers = m_config.phonemizerWorkers;
+        phonemizerConfig.espeakDataPath = m_config.espeakDataPath;
+        m_phonemizers = std::make_unique<PhonemizerPool>(phonemizerConfig);
+    }
+    m_config.pool.numWorkers = m_config.numWorkers;
+    m_pool = std::make_unique<SessionPool>(m_config.modelPath, m_config.pool);
+}
+
+SynthesisServer::~SynthesisServer() { stop(); }
+
+void SynthesisServer::start() {
+    if (m_started) {
+        return;
+    }
+
+    if (!m_config.unixSocketPath.empty()) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (m_config.unixSocketPath.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Unix socket path too long: " + m_config.unixSocketPath);
+        }
+        std::strcpy(address.sun_path, m_config.unixSocketPath.c_str());
+
+        // A socket file left behind by a previous run would fail the bind;
+        // anything else at the path is not ours to remove
+        if (isSocketFile(m_config.unixSocketPath)) {
+            unlink(m_config.unixSocketPath.c_str());
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(fd, SOMAXCONN) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Failed to listen on " + m_config.unixSocketPath);
+        }
+        m_listeners.push_back(fd);
+    }
+
+    if (m_config.tcpPort >= 0) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)m_config.tcpPort);
+        if (inet_pton(AF_INET, m_config.bindAddress.c_str(), &address.sin_addr) != 1) {
+            throw std::runtime_error("Invalid bind address: " + m_config.bindAddress);
+        }
+
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+        if (fd < 0 || bind(fd, (sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(fd, SOMAXCONN) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Failed to listen on " + m_config.bindAddress + ":" +
+                                     std::to_string(m_config.tcpPort));
+        }
+        socklen_t length = sizeof(address);
+        getsockname(fd, (sockaddr *)&address, &length);
+        m_tcpPort = ntohs(address.sin_port);
+        m_listeners.push_back(fd);
+    }
+
+    if (pipe2(m_wakePipe, O_CLOEXEC) != 0) {
+        throw std::runtime_error("Failed to create wake pipe");
+    }
+
+    m_started = true;
+    m_acceptThread = std::thread(&SynthesisServer::acceptLoop, this);
+    for (size_t i = 0; i < m_config.numWorkers; i++) {
+        m_workers.emplace_back(&SynthesisServer::workerLoop, this);
+    }
+}
+
+void SynthesisServer::stop() {
+    if (!m_started) {
+        return;
+    }
+    m_started = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    char wake = 0;
+    if (write(m_wakePipe[1], &wake, 1) < 0) {
+        // The accept loop also polls with a timeout
+    }
+    m_acceptThread.join();
+
+    m_connectionsReady.notify_all();
+    for (std::thread &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+
+    for (int fd : m_listeners) {
+        close(fd);
+    }
+    m_listeners.clear();
+    close(m_wakePipe[0]);
+    close(m_wakePipe[1]);
+    if (!m_config.unixSocketPath.empty() && isSocketFile(m_config.unixSocketPath)) {
+        unlink(m_config.unixSocketPath.c_str());
+    }
+}
+
+void SynthesisServer::acceptLoop() {
+    std::vector<pollfd> pollFds;
+    for (int fd : m_listeners) {
+        pollFds.push_back({fd, POLLIN, 0});
+    }
+    pollFds.push_back({m_wakePipe[0], POLLIN, 0});
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) {
+                return;
+            }
+        }
+        if (poll(pollFds.data(), pollFds.size(), 1000) <= 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i + 1 < pollFds.size(); i++) {
+            if (!(pollFds[i].revents & POLLIN)) {
+                continue;
+            }
+            int fd = accept4(pollFds[i].fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            timeval receiveTimeout{RECEIVE_TIMEOUT_SECONDS, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &receiveTimeout, sizeof(receiveTimeout));
+            timeval sendTimeout{SEND_TIMEOUT_SECONDS, 0};
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+
+            bool queued = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_connections.size() < m_config.maxPendingConnections) {
+                    m_connections.push_back(fd);
+                    queued = true;
+                }
+            }
+            if (queued) {
+                metrics().queueDepth.add(1);
+                m_connectionsReady.notify_one();
+            } else {
+                sendResponse(fd, "503 Service Unavailable", "text/plain", "busy\n");
+                close(fd);
+            }
+        }
+    }
+}
+
+void SynthesisServer::workerLoop() {
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_connectionsReady.wait(lock, [this]() {
+                return m_stopping || !m_connections.empty();
+            });
+            if (m_connections.empty()) {
+                // Stopping and fully drained
+                return;
+            }
+            fd = m_connections.front();
+            m_connections.pop_front();
+        }
+        metrics().queueDepth.add(-1);
+
+        try {
+            handleConnection(fd);
+        } catch (const std::exception &e) {
+            if (logEnabled(LogLevel::Error)) {
+                std::cerr << "Request failed: " << e.what() << std::endl;
+            }
+        }
+        close(fd);
+    }
+}
+
+bool SynthesisServer::readRequest(int fd, Request &request, std::string &error) {
+    std::string data;
+    size_t headerEnd;
+    char buffer[4096];
+    while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+        if (data.size() > MAX_HEADER_BYTES) {
+            error = "431 Request Header Fields Too Large";
+            return false;
+        }
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            error = "400 Bad Request";
+            return false;
+        }
+        data.append(buffer, (size_t)received);
+    }
+
+    // Request line: METHOD target HTTP/1.x
+    size_t lineEnd = data.find("\r\n");
+    std::string line = data.substr(0, lineEnd);
+    size_t methodEnd = line.find(' ');
+    size_t targetEnd = line.find(' ', methodEnd + 1);
+    if (methodEnd == std::string::npos || targetEnd == std::string::npos) {
+        error = "400 Bad Request";
+        return false;
+    }
+    request.method = line.substr(0, methodEnd);
+    std::string target = line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+    size_t queryStart = target.find('?');
+    request.path = target.substr(0, queryStart);
+    if (queryStart != std::string::npos) {
+        request.query = parseQuery(target.substr(queryStart + 1));
+    }
+
+    size_t contentLength = 0;
+    size_t position = lineEnd + 2;
+    while (position < headerEnd) {
+        size_t end = data.find("\r\n", position);
+        std::string header = data.substr(position, end - position);
+        position = end + 2;
+
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = header.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return (char)std::tolower(c); });
+        std::string value = header.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+
+        if (name == "content-length") {
+            try {
+                contentLength = std::stoul(value);
+            } catch (const std::exception &) {
+                error = "400 Bad Request";
+                return false;
+            }
+        } else if (name == "transfer-encoding") {
+            error = "411 Length Required";
+            return false;
+        }
+    }
+    if (contentLength > m_config.maxBodyBytes) {
+        error = "413 Payload Too Large";
+        return false;
+    }
+
+    request.body = data.substr(headerEnd + 4);
+    while (request.body.size() < contentLength) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            error = "400 Bad Request";
+            return false;
+        }
+        request.body.append(buffer, (size_t)received);
+    }
+    request.body.resize(contentLength);
+    return true;
+}
+
+void SynthesisServer::handleConnection(int fd) {
+    Request request;
+    std::string error;
+    if (!readRequest(fd, request, error)) {
+        sendResponse(fd, error, "text/plain", error + "\n");
+        return;
+    }
+
+    if (request.path == "/synthesize") {
+        if (request.method != "POST" && request.method != "GET") {
+            sendResponse(fd, "405 Method Not Allowed", "text/plain", "use POST\n");
+            return;
+        }
+        handleSynthesize(fd, request);
+    } else if (request.path == "/metrics") {
+        sendResponse(fd, "200 OK", "text/plain; version=0.0.4", exportPrometheus());
+    } else if (request.path == "/health") {
+        sendResponse(fd, "200 OK", "text/plain", "ok\n");
+    } else {
+        sendResponse(fd, "404 Not Found", "text/plain", "not found\n");
+    }
+}
+
+void SynthesisServer::handleSynthesize(int fd, const Request &request) {
+    SynthesisConfig synthesisConfig = m_config.synthesisConfig;
+    eSpeakPhonemeConfig eSpeakConfig = m_config.eSpeakConfig;
+    bool wav = true;
+    std::string text = request.body;
+    std::unique_ptr<Resampler> resampler;
+
+    try {
+        for (const auto &param : request.query) {
+            const std::string &name = param.first;
+            const std::string &value = param.second;
+            if (name == "speaker") {
+                synthesisConfig.speakerId = (SpeakerId)std::stoll(value);
+            } else if (name == "noise_scale") {
+                synthesisConfig.noiseScale = std::stof(value);
+            } else if (name == "length_scale") {
+                synthesisConfig.lengthScale = std::stof(value);
+            } else if (name == "noise_w") {
+                synthesisConfig.noiseW = std::stof(value);
+            } else if (name == "voice") {
+                eSpeakConfig.voice = value;
+            } else if (name == "text") {
+                if (text.empty()) {
+                    text = value;
+                }
+            } else if (name == "format") {
+                if (value != "wav" && value != "pcm") {
+                    throw std::invalid_argument("format must be wav or pcm");
+                }
+                wav = (value == "wav");
+            } else if (name == "rate") {
+                synthesisConfig.outputSampleRate = std::stoi(value);
+            }
+        }
+        // Checks the rate pair before the response is started
+        resampler = std::make_unique<Resampler>(synthesisConfig.sampleRate,
+                                                synthesisConfig.outputRate());
+    } catch (const std::exception &e) {
+        sendResponse(fd, "400 Bad Request", "text/plain",
+                     std::string("invalid parameter: ") + e.what() + "\n");
+        return;
+    }
+    if (text.empty()) {
+        sendResponse(fd, "400 Bad Request", "text/plain", "no text\n");
+        return;
+    }
+
+    // Phonemize up front (under the espeak-ng lock, unless helper processes
+    // do it), so synthesis of different requests overlaps freely
+    std::vector<std::vector<int64_t>> clauses;
+    try {
+        if (m_phonemizers) {
+            clauses = m_phonemizers->clauseSequences(text, eSpeakConfig);
+        } else {
+            std::lock_guard<std::mutex> lock(eSpeakMutex());
+            phonemize_eSpeak_clauses(text, eSpeakConfig, [&](PhonemeClause &clause) {
+                if (!clause.phonemes.empty()) {
+                    clauses.push_back(
+                        phonemes_to_sequence(clause_phonemes(clause, eSpeakConfig)));
+                }
+                return true;
+            });
+        }
+    } catch (const std::exception &e) {
+        sendResponse(fd, "400 Bad Request", "text/plain",
+                     std::string("phonemization failed: ") + e.what() + "\n");
+        return;
+    }
+
+    std::string headers = std::string("HTTP/1.1 200 OK\r\n") +
+                          "Content-Type: " + (wav ? "audio/wav" : "application/octet-stream") +
+                          "\r\n" +
+                          "X-Sample-Rate: " + std::to_string(synthesisConfig.outputRate()) +
+                          "\r\n" +
+                          "Transfer-Encoding: chunked\r\n" +
+                          "Connection: close\r\n\r\n";
+    if (!sendAll(fd, headers.data(), headers.size())) {
+        return;
+    }
+
+    if (wav) {
+        // The total length isn't known yet; players treat all-ones sizes as
+        // "until end of stream"
+        std::ostringstream headerStream;
+        writeWavHeader(synthesisConfig.outputRate(), synthesisConfig.sampleWidth,
+                       synthesisConfig.channels, 0, headerStream);
+        std::string header = headerStream.str();
+        uint32_t unknownSize = 0xFFFFFFFF;
+        std::memcpy(&header[offsetof(WavHeader, chunkSize)], &unknownSize, sizeof(unknownSize));
+        std::memcpy(&header[offsetof(WavHeader, dataSize)], &unknownSize, sizeof(unknownSize));
+        if (!sendChunk(fd, header.data(), header.size())) {
+            return;
+        }
+    }
+
+    // The status line is out, so a failure from here on can't become an
+    // error response. Cut the connection instead: without the terminating
+    // chunk the client sees a truncated body rather than a complete one.
+    try {
+        // Shared across clauses so GainMode::Running carries over between chunks
+        AudioConverter converter(synthesisConfig.gainMode, synthesisConfig.fixedGain);
+        std::vector<int16_t> audioBuffer;
+        std::vector<int16_t> clauseAudio;
+        std::vector<int16_t> resampled;
+        for (std::vector<int64_t> &phonemeIds : clauses) {
+            // Trimmed audio of the clause's pieces, each followed by its pause
+            clauseAudio.clear();
+            {
+                SessionPool::Lease lease = m_pool->acquire();
+                SynthesisResult result;
+                appendClauses(
+                    phonemeIds, synthesisConfig,
+                    maxIdsPerRun(lease.session(), synthesisConfig),
+                    [&](const int64_t *ids, size_t numIds, size_t &numSamples,
+                        SynthesisResult &pieceResult) -> const int16_t * {
+                        if (m_config.pool.useIoBinding) {
+                            BoundInference &bound = lease.boundInference();
+                            numSamples =
+                                bound.run(ids, numIds, synthesisConfig, pieceResult, &converter);
+                            return bound.audio();
+                        }
+                        std::vector<int64_t> pieceIds(ids, ids + numIds);
+                        audioBuffer.clear();
+                        Synthesize(pieceIds, synthesisConfig, lease.session(), audioBuffer,
+                                   pieceResult, &converter);
+                        numSamples = audioBuffer.size();
+                        return audioBuffer.data();
+                    },
+                    clauseAudio, result);
+            }
+
+            const int16_t *samples = clauseAudio.data();
+            size_t numSamples = clauseAudio.size();
+            if (!resampler->passthrough()) {
+                resampled.clear();
+                resampler->process(samples, numSamples, resampled);
+                samples = resampled.data();
+                numSamples = resampled.size();
+            }
+
+            StageTimer timer(Stage::Output);
+            if (!sendChunk(fd, samples, numSamples * sizeof(int16_t))) {
+                // Client went away; skip the remaining clauses
+                return;
+            }
+        }
+        resampled.clear();
+        resampler->flush(resampled);
+        if (!resampled.empty() &&
+            !sendChunk(fd, resampled.data(), resampled.size() * sizeof(int16_t))) {
+            return;
+        }
+        sendAll(fd, "0\r\n\r\n", 5);
+    } catch (const std::exception &e) {
+        metrics().streamErrors.add();
+        if (logEnabled(LogLevel::Error)) {
+            std::cerr << "Synthesis failed mid-stream: " << e.what() << std::endl;
+        }
+        shutdown(fd, SHUT_RDWR);
+    }
+}
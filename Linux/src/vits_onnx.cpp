@@ -0,0 +1,728 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "vits_onnx.h"
+#include "audio_cache.h"
+#include "bound_inference.h"
+#include "chunked_decoder.h"
+#include "metrics.h"
+#include "phonemizer_pool.h"
+#include "resampler.h"
+#include "silence.h"
+#include "espeak-ng/speak_lib.h"
+
+const std::string instanceName{"vits"};
+
+const char *precisionName(ModelPrecision precision) {
+    switch (precision) {
+    case ModelPrecision::Float32:
+        return "fp32";
+    case ModelPrecision::Float16:
+        return "fp16";
+    case ModelPrecision::Int8:
+        return "int8";
+    }
+    return "unknown";
+}
+
+std::string siblingModelPath(const std::string &modelPath, const std::string &part) {
+    size_t dot = modelPath.rfind('.');
+    size_t slash = modelPath.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return modelPath + "." + part + ".onnx";
+    }
+    return modelPath.substr(0, dot) + "." + part + modelPath.substr(dot);
+}
+
+std::string modelVariantPath(const std::string &modelPath, ModelPrecision precision) {
+    if (precision == ModelPrecision::Float32) {
+        return modelPath;
+    }
+    return siblingModelPath(modelPath, precisionName(precision));
+}
+
+std::vector<ModelPrecision> findModelVariants(const std::string &modelPath) {
+    std::vector<ModelPrecision> variants;
+    for (ModelPrecision precision : {ModelPrecision::Float32, ModelPrecision::Float16,
+                                     ModelPrecision::Int8}) {
+        struct stat fileStat;
+        if (stat(modelVariantPath(modelPath, precision).c_str(), &fileStat) == 0) {
+            variants.push_back(precision);
+        }
+    }
+    return variants;
+}
+
+const float *audioData(const Ort::Value &tensor, std::vector<float> &scratch) {
+    auto info = tensor.GetTensorTypeAndShapeInfo();
+    switch (info.GetElementType()) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+        return tensor.GetTensorData<float>();
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: {
+        size_t count = info.GetElementCount();
+        scratch.resize(count);
+        halfToFloat(reinterpret_cast<const uint16_t *>(
+                        tensor.GetTensorData<Ort::Float16_t>()),
+                    count, scratch.data());
+        return scratch.data();
+    }
+    default:
+        throw std::runtime_error("Model output must be float or float16");
+    }
+}
+
+void configureSession(ModelSession &session, bool useCuda) {
+    if (useCuda) {
+        // Use CUDA provider
+        OrtCUDAProviderOptions cuda_options{};
+        cuda_options.cudnn_conv_algo_search = OrtCudnnConvAlgoSearchHeuristic;
+        session.options.AppendExecutionProvider_CUDA(cuda_options);
+    }
+
+    const SessionTuning &tuning = session.tuning;
+    if (tuning.intraOpThreads > 0) {
+        session.options.SetIntraOpNumThreads(tuning.intraOpThreads);
+    }
+    if (tuning.interOpThreads > 0) {
+        session.options.SetInterOpNumThreads(tuning.interOpThreads);
+    }
+    session.options.SetGraphOptimizationLevel(tuning.graphOptimizationLevel);
+    session.options.SetExecutionMode(tuning.executionMode);
+
+    if (tuning.cpuMemArena) {
+        session.options.EnableCpuMemArena();
+    } else {
+        session.options.DisableCpuMemArena();
+    }
+    if (tuning.memPattern) {
+        session.options.EnableMemPattern();
+    } else {
+        session.options.DisableMemPattern();
+    }
+    session.options.DisableProfiling();
+}
+
+void createSession(const std::string &modelPath, ModelSession &session,
+                   Ort::Env &env) {
+    #ifdef _WIN32
+    auto modelPathW = std::wstring(modelPath.begin(), modelPath.end());
+    auto modelPathStr = modelPathW.c_str();
+    #else
+    auto modelPathStr = modelPath.c_str();
+    #endif
+
+    session.onnx = Ort::Session(env, modelPathStr, session.options);
+    inspectSessionOutputs(session);
+}
+
+void loadModel(std::string modelPath, ModelSession &session, bool useCuda) {
+    session.env = Ort::Env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING,
+                            instanceName.c_str());
+    session.env.DisableTelemetryEvents();
+
+    configureSession(session, useCuda);
+    createSession(modelPath, session, session.env);
+}
+
+void convertAudio(const float *audio, int64_t audioCount,
+                  std::vector<int16_t> &audioBuffer, AudioConverter &converter) {
+    StageTimer timer(Stage::Postprocess);
+
+    // We know the size up front, so convert straight into the buffer
+    size_t offset = audioBuffer.size();
+    audioBuffer.resize(offset + audioCount);
+    converter.convert(audio, audioCount, audioBuffer.data() + offset);
+}
+
+uint64_t predictedRunBytes(const ModelSession &session, size_t numIds,
+                           const SynthesisConfig &synthesisConfig) {
+    // Padding ids are run like real ones
+    const MemoryBudget &budget = session.memoryBudget;
+    double runIds = (double)bucketLength(session.tuning, (int64_t)numIds);
+    double samples = runIds * budget.samplesPerId * synthesisConfig.lengthScale;
+    return (uint64_t)(samples * budget.bytesPerSample);
+}
+
+size_t maxIdsPerRun(const ModelSession &session, const SynthesisConfig &synthesisConfig) {
+    const MemoryBudget &budget = session.memoryBudget;
+    double bytesPerId =
+        budget.samplesPerId * synthesisConfig.lengthScale * budget.bytesPerSample;
+    if (budget.maxBytes == 0 || bytesPerId <= 0) {
+        return std::numeric_limits<size_t>::max();
+    }
+    size_t maxIds = (size_t)((double)budget.maxBytes / bytesPerId);
+
+    // The budget holds for the padded length, so below the largest bucket
+    // only inputs whose bucket fits are allowed
+    const std::vector<int64_t> &buckets = session.tuning.lengthBuckets;
+    if (!buckets.empty() && maxIds < (size_t)buckets.back()) {
+        auto fits = std::upper_bound(buckets.begin(), buckets.end(), (int64_t)maxIds);
+        maxIds = (fits == buckets.begin()) ? 0 : (size_t)*(fits - 1);
+    }
+    // Always make progress, even if a single id is over budget
+    return std::max<size_t>(1, maxIds);
+}
+
+// Runs the model once and passes its float audio (trimmed to output_lengths)
+// to consume while the output tensors are still alive
+static void runSynthesis(std::vector<int64_t> &phonemeIds,
+                         SynthesisConfig &synthesisConfig, ModelSession &session,
+                         SynthesisResult &result,
+                         const std::function<void(const float *, int64_t)> &consume) {
+
+    auto memoryInfo = Ort::MemoryInfo::CreateCpu(
+                        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    
+    // Zero-pad up to the length bucket; input_lengths keeps the real length
+    int64_t numIds = (int64_t)phonemeIds.size();
+    int64_t paddedLength = bucketLength(session.tuning, numIds);
+    std::vector<int64_t> paddedIds;
+    int64_t *inputIds = phonemeIds.data();
+    if (paddedLength > numIds) {
+        paddedIds.assign(paddedLength, 0);
+        std::copy(phonemeIds.begin(), phonemeIds.end(), paddedIds.begin());
+        inputIds = paddedIds.data();
+    }
+
+    std::vector<int64_t> phonemeIdLengths{numIds};
+    std::vector<float> scales{synthesisConfig.noiseScale,
+                                synthesisConfig.lengthScale,
+                                synthesisConfig.noiseW};
+
+    std::vector<Ort::Value> inputTensors;
+    std::vector<int64_t> phonemeIdsShape{1, paddedLength};
+    inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+        memoryInfo, inputIds, paddedLength, phonemeIdsShape.data(),
+        phonemeIdsShape.size()));
+
+    std::vector<int64_t> phomemeIdLengthsShape{(int64_t)phonemeIdLengths.size()};
+    inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+        memoryInfo, phonemeIdLengths.data(), phonemeIdLengths.size(),
+        phomemeIdLengthsShape.data(), phomemeIdLengthsShape.size()));
+
+    std::vector<int64_t> scalesShape{(int64_t)scales.size()};
+    inputTensors.push_back(
+        Ort::Value::CreateTensor<float>(memoryInfo, scales.data(), scales.size(),
+                                        scalesShape.data(), scalesShape.size()));
+    // Add speaker id.
+    // NOTE: These must be kept outside the "if" below to avoid being deallocated.
+    std::vector<int64_t> speakerId{(int64_t)synthesisConfig.speakerId.value_or(0)};
+    std::vector<int64_t> speakerIdShape{(int64_t)speakerId.size()};
+
+    if (synthesisConfig.speakerId) {
+        inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+            memoryInfo, speakerId.data(), speakerId.size(), speakerIdShape.data(),
+            speakerIdShape.size()));
+    }
+    // From export_onnx.py
+    std::array<const char *, 4> inputNames = {"input", "input_lengths", "scales",
+                                                "sid"};
+    std::array<const char *, 2> outputNames = {"output", "output_lengths"};
+
+    // Padding is masked, but trim to output_lengths when the graph has it
+    size_t outputCount =
+        ((paddedLength > numIds) && hasOutputLengths(session)) ? 2 : 1;
+
+    // Infer
+    auto startTime = std::chrono::steady_clock::now();
+    auto outputTensors = session.onnx.Run(
+        Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(),
+        inputTensors.size(), outputNames.data(), outputCount);
+    auto endTime = std::chrono::steady_clock::now();
+    auto inferDuration = std::chrono::duration<double>(endTime - startTime);
+    result.inferSeconds = inferDuration.count();
+    metrics().stage(Stage::Run).observe(result.inferSeconds);
+    if ((outputTensors.size() != outputCount) || (!outputTensors.front().IsTensor())) {
+        throw std::runtime_error("Invalid output tensors");
+    }
+
+    std::vector<float> halfScratch;
+    const float *audio = audioData(outputTensors.front(), halfScratch);
+    auto audioShape =
+        outputTensors.front().GetTensorTypeAndShapeInfo().GetShape();
+    int64_t audioCount = audioShape[audioShape.size() - 1];
+    if (outputCount > 1) {
+        audioCount = std::min(audioCount, outputTensors[1].GetTensorData<int64_t>()[0]);
+    }
+
+    result.audioSeconds = (double)audioCount / (double)synthesisConfig.sampleRate;
+    result.realTimeFactor = 0.0;
+    if (result.audioSeconds > 0) {
+        result.realTimeFactor = result.inferSeconds / result.audioSeconds;
+    }
+    metrics().recordClause(result);
+
+    consume(audio, audioCount);
+
+    // Clean up
+    for (std::size_t i = 0; i < outputTensors.size(); i++) {
+        Ort::detail::OrtRelease(outputTensors[i].release());
+    }
+
+    for (std::size_t i = 0; i < inputTensors.size(); i++) {
+        Ort::detail::OrtRelease(inputTensors[i].release());
+    }
+}
+
+void Synthesize(std::vector<int64_t> &phonemeIds,
+                SynthesisConfig &synthesisConfig, ModelSession &session,
+                std::vector<int16_t> &audioBuffer, SynthesisResult &result,
+                AudioConverter *converter) {
+    runSynthesis(phonemeIds, synthesisConfig, session, result,
+                 [&](const float *audio, int64_t audioCount) {
+                     if (converter) {
+                         convertAudio(audio, audioCount, audioBuffer, *converter);
+                     } else {
+                         AudioConverter configConverter(synthesisConfig.gainMode,
+                                                        synthesisConfig.fixedGain);
+                         convertAudio(audio, audioCount, audioBuffer, configConverter);
+                     }
+                 });
+}
+
+void SynthesizeFloat(std::vector<int64_t> &phonemeIds,
+                     SynthesisConfig &synthesisConfig, ModelSession &session,
+                     std::vector<float> &audioBuffer, SynthesisResult &result) {
+    runSynthesis(phonemeIds, synthesisConfig, session, result,
+                 [&](const float *audio, int64_t audioCount) {
+                     audioBuffer.insert(audioBuffer.end(), audio, audio + audioCount);
+                 });
+}
+
+void inspectSessionOutputs(ModelSession &session) {
+    session.outputLengths = false;
+    for (size_t i = 0; i < session.onnx.GetOutputCount(); i++) {
+        auto name = session.onnx.GetOutputNameAllocated(i, session.allocator);
+        if (std::string(name.get()) == "output_lengths") {
+            session.outputLengths = true;
+        }
+    }
+}
+
+void SynthesizeBatch(const std::vector<std::vector<int64_t>> &batchPhonemeIds,
+                     const std::vector<SynthesisConfig> &batchConfigs,
+                     ModelSession &session,
+                     std::vector<std::vector<int16_t>> &audioBuffers,
+                     std::vector<SynthesisResult> &results) {
+    size_t batchSize = batchPhonemeIds.size();
+    if (batchSize == 0 || batchConfigs.size() != batchSize) {
+        throw std::invalid_argument("Batch needs one config per phoneme sequence");
+    }
+
+    const SynthesisConfig &synthesisConfig = batchConfigs.front();
+    for (const SynthesisConfig &config : batchConfigs) {
+        if (!canShareBatch(config, synthesisConfig)) {
+            throw std::invalid_argument("Batched requests must share scales");
+        }
+    }
+
+    auto memoryInfo = Ort::MemoryInfo::CreateCpu(
+                        OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+    // Pad to the longest sequence; input_lengths keeps the padding masked out
+    int64_t maxLength = 0;
+    std::vector<int64_t> phonemeIdLengths;
+    for (const std::vector<int64_t> &phonemeIds : batchPhonemeIds) {
+        phonemeIdLengths.push_back((int64_t)phonemeIds.size());
+        maxLength = std::max(maxLength, (int64_t)phonemeIds.size());
+    }
+
+    std::vector<int64_t> phonemeIds(batchSize * maxLength, 0);
+    for (size_t b = 0; b < batchSize; b++) {
+        std::copy(batchPhonemeIds[b].begin(), batchPhonemeIds[b].end(),
+                  phonemeIds.begin() + b * maxLength);
+    }
+
+    std::vector<float> scales{synthesisConfig.noiseScale,
+                                synthesisConfig.lengthScale,
+                                synthesisConfig.noiseW};
+
+    std::vector<Ort::Value> inputTensors;
+    std::vector<int64_t> phonemeIdsShape{(int64_t)batchSize, maxLength};
+    inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+        memoryInfo, phonemeIds.data(), phonemeIds.size(), phonemeIdsShape.data(),
+        phonemeIdsShape.size()));
+
+    std::vector<int64_t> phomemeIdLengthsShape{(int64_t)phonemeIdLengths.size()};
+    inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+        memoryInfo, phonemeIdLengths.data(), phonemeIdLengths.size(),
+        phomemeIdLengthsShape.data(), phomemeIdLengthsShape.size()));
+
+    std::vector<int64_t> scalesShape{(int64_t)scales.size()};
+    inputTensors.push_back(
+        Ort::Value::CreateTensor<float>(memoryInfo, scales.data(), scales.size(),
+                                        scalesShape.data(), scalesShape.size()));
+
+    // NOTE: These must be kept outside the "if" below to avoid being deallocated.
+    std::vector<int64_t> speakerIds;
+    for (const SynthesisConfig &config : batchConfigs) {
+        speakerIds.push_back((int64_t)config.speakerId.value_or(0));
+    }
+    std::vector<int64_t> speakerIdShape{(int64_t)speakerIds.size()};
+
+    if (synthesisConfig.speakerId) {
+        inputTensors.push_back(Ort::Value::CreateTensor<int64_t>(
+            memoryInfo, speakerIds.data(), speakerIds.size(), speakerIdShape.data(),
+            speakerIdShape.size()));
+    }
+
+    std::array<const char *, 4> inputNames = {"input", "input_lengths", "scales",
+                                                "sid"};
+    std::array<const char *, 2> outputNames = {"output", "output_lengths"};
+    size_t outputCount = (batchSize > 1) ? 2 : 1;
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto outputTensors = session.onnx.Run(
+        Ort::RunOptions{nullptr}, inputNames.data(), inputTensors.data(),
+        inputTensors.size(), outputNames.data(), outputCount);
+    auto endTime = std::chrono::steady_clock::now();
+    double inferSeconds = std::chrono::duration<double>(endTime - startTime).count();
+    metrics().stage(Stage::Run).observe(inferSeconds);
+
+    if ((outputTensors.size() != outputCount) || (!outputTensors.front().IsTensor())) {
+        throw std::runtime_error("Invalid output tensors");
+    }
+
+    // output is [B, 1, T_max]; every row is padded to the longest item
+    std::vector<float> halfScratch;
+    const float *audio = audioData(outputTensors.front(), halfScratch);
+    auto audioShape =
+        outputTensors.front().GetTensorTypeAndShapeInfo().GetShape();
+    int64_t rowLength = audioShape[audioShape.size() - 1];
+    const int64_t *audioLengths =
+        (outputCount > 1) ? outputTensors[1].GetTensorData<int64_t>() : &rowLength;
+
+    audioBuffers.resize(batchSize);
+    results.resize(batchSize);
+    for (size_t b = 0; b < batchSize; b++) {
+        int64_t audioCount = std::min(audioLengths[b], rowLength);
+        audioBuffers[b].clear();
+        AudioConverter converter(batchConfigs[b].gainMode, batchConfigs[b].fixedGain);
+        convertAudio(audio + b * rowLength, audioCount, audioBuffers[b], converter);
+
+        // The whole batch finishes together, so each item waited for all of it
+        SynthesisResult &result = results[b];
+        result.inferSeconds = inferSeconds;
+        result.audioSeconds = (double)audioCount / (double)batchConfigs[b].sampleRate;
+        result.realTimeFactor = 0.0;
+        if (result.audioSeconds > 0) {
+            result.realTimeFactor = result.inferSeconds / result.audioSeconds;
+        }
+        metrics().recordClause(result);
+    }
+}
+
+void initializeESpeak(const std::string &espeakDataPath) {
+    static std::once_flag initialized;
+    std::call_once(initialized, [&espeakDataPath]() {
+        int result = espeak_Initialize(AUDIO_OUTPUT_SYNCHRONOUS, 0,
+                                       espeakDataPath.c_str(), 0);
+        if (result < 0) {
+            throw std::runtime_error("Failed to initialize eSpeak");
+        }
+    });
+}
+
+VitsONNX::VitsONNX(const std::string &modelPath,
+                   const std::string &espeakDataPath, bool useCuda)
+    : m_useCuda(useCuda), m_modelPath(modelPath) {
+    auto startTime = std::chrono::steady_clock::now();
+    initializeESpeak(espeakDataPath);
+    loadSessionTuning(defaultTuningPath(modelPath), m_session.tuning);
+    loadModel(modelPath, m_session, useCuda);
+    auto endTime = std::chrono::steady_clock::now();
+    m_loadSeconds = std::chrono::duration<double>(endTime - startTime).count();
+}
+
+VitsONNX::VitsONNX(const std::string &modelPath,
+                   const std::string &espeakDataPath, bool useCuda,
+                   const ColdStartConfig &coldStart)
+    : m_useCuda(useCuda), m_modelPath(modelPath) {
+    auto startTime = std::chrono::steady_clock::now();
+    initializeESpeak(espeakDataPath);
+    loadSessionTuning(defaultTuningPath(modelPath), m_session.tuning);
+    loadModelCached(modelPath, m_session, useCuda, coldStart, m_coldStartStats);
+    m_coldStartStats.warmupSeconds = warmUp(coldStart.warmupLengths);
+    auto endTime = std::chrono::steady_clock::now();
+    m_loadSeconds = std::chrono::duration<double>(endTime - startTime).count();
+    m_coldStartStats.coldStartSeconds = m_loadSeconds;
+    metrics().recordColdStart(m_coldStartStats);
+}
+
+VitsONNX::~VitsONNX() = default;
+
+double VitsONNX::warmUp(const std::vector<size_t> &lengths) {
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t length : lengths) {
+        std::vector<int64_t> phonemeIds = warmupSequence(length);
+        std::vector<int16_t> audioBuffer;
+        SynthesisResult result;
+        synthesizeIds(phonemeIds, audioBuffer, result);
+    }
+    auto endTime = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(endTime - startTime).count();
+}
+
+BoundInference &VitsONNX::bound() {
+    if (!m_bound) {
+        m_bound = std::make_unique<BoundInference>(m_session);
+    }
+    return *m_bound;
+}
+
+// Split graphs are only loaded once a stream actually needs them
+ChunkedDecoder *VitsONNX::chunkedDecoder() {
+    if (!m_chunkedChecked) {
+        m_chunkedChecked = true;
+        if (useChunkedDecoder && hasSplitModel(m_modelPath)) {
+            m_chunked = std::make_unique<ChunkedDecoder>(
+                encoderModelPath(m_modelPath), decoderModelPath(m_modelPath), m_useCuda,
+                chunkedDecoderConfig);
+        }
+    }
+    return useChunkedDecoder ? m_chunked.get() : nullptr;
+}
+
+void VitsONNX::synthesizeIds(std::vector<int64_t> &phonemeIds,
+                             std::vector<int16_t> &audioBuffer,
+                             SynthesisResult &result) {
+    if (useIoBinding) {
+        audioBuffer.clear();
+        appendDecodedClauses(
+            phonemeIds, synthesisConfig, maxIdsPerRun(m_session, synthesisConfig),
+            [this](const int64_t *ids, size_t numIds, size_t &numSamples,
+                   SynthesisResult &clauseResult) {
+                return bound().decode(ids, numIds, synthesisConfig, clauseResult, numSamples);
+            },
+            audioBuffer, result);
+    } else {
+        SynthesizeClauses(phonemeIds, synthesisConfig, m_session, audioBuffer, result);
+    }
+    result.predictedPeakBytes =
+        predictedRunBytes(m_session, result.longestRunIds, synthesisConfig);
+}
+
+std::vector<int16_t> VitsONNX::inference(const std::string &text) {
+    SynthesisResult result;
+    return inference(text, result);
+}
+
+std::vector<int64_t> VitsONNX::textToSequence(const std::string &text) {
+    auto phonemize = [this](const std::string &input) {
+        if (phonemizerPool) {
+            return phonemizerPool->textToSequence(input, eSpeakConfig);
+        }
+        std::lock_guard<std::mutex> lock(eSpeakMutex());
+        return text_to_sequence(input, eSpeakConfig);
+    };
+    if (phonemeCache) {
+        bool miss = false;
+        std::vector<int64_t> phonemeIds = phonemeCache->get(
+            eSpeakConfig.voice, text, [&phonemize, &miss](const std::string &normalized) {
+                miss = true;
+                return phonemize(normalized);
+            });
+        (miss ? metrics().phonemeCacheMisses : metrics().phonemeCacheHits).add();
+        return phonemeIds;
+    }
+    return phonemize(text);
+}
+
+// Hashing the model file is only worth it once an audio cache is in use
+uint64_t VitsONNX::modelHash() {
+    std::call_once(m_modelHashOnce, [this]() {
+        m_modelHash = AudioCache::hashFile(m_modelPath);
+    });
+    return m_modelHash;
+}
+
+std::vector<int16_t> VitsONNX::inference(const std::string &text,
+                                         SynthesisResult &result) {
+    std::vector<int16_t> audioBuffer;
+    if (audioCache && audioCache->enabled()) {
+        std::shared_ptr<const MappedAudio> audio = inferenceMapped(text, result);
+        audioBuffer.assign(audio->samples(), audio->samples() + audio->numSamples());
+    } else {
+        std::vector<int64_t> phonemeIds = textToSequence(text);
+        synthesizeIds(phonemeIds, audioBuffer, result);
+    }
+    resampleAudio(audioBuffer, synthesisConfig.sampleRate, synthesisConfig.outputRate());
+    return audioBuffer;
+}
+
+std::shared_ptr<const MappedAudio> VitsONNX::inferenceMapped(const std::string &text,
+                                                             SynthesisResult &result) {
+    if (!audioCache) {
+        throw std::logic_error("inferenceMapped needs an audioCache");
+    }
+
+    std::vector<int64_t> phonemeIds = textToSequence(text);
+    uint64_t key =
+        AudioCache::makeKey(phonemeIds, synthesisConfig, modelHash(),
+                            maxIdsPerRun(m_session, synthesisConfig));
+    std::shared_ptr<const MappedAudio> audio = audioCache->lookup(key);
+    if (audio) {
+        metrics().audioCacheHits.add();
+        result = SynthesisResult();
+        result.audioSeconds = (double)audio->numSamples() / (double)audio->sampleRate();
+        return audio;
+    }
+
+    metrics().audioCacheMisses.add();
+
+    std::vector<int16_t> audioBuffer;
+    synthesizeIds(phonemeIds, audioBuffer, result);
+    audioCache->store(key, audioBuffer.data(), audioBuffer.size(),
+                      synthesisConfig.sampleRate);
+    return MappedAudio::fromBuffer(std::move(audioBuffer), synthesisConfig.sampleRate);
+}
+
+void VitsONNX::inferenceStream(const std::string &text,
+                               const AudioChunkCallback &onAudio,
+                               SynthesisResult &result) {
+    auto startTime = std::chrono::steady_clock::now();
+    result = SynthesisResult();
+
+    ChunkedDecoder *chunked = chunkedDecoder();
+
+    // Peak normalization needs a whole clause, which chunks never see
+    GainMode gainMode = synthesisConfig.gainMode;
+    if (chunked && gainMode == GainMode::Peak) {
+        gainMode = GainMode::Running;
+    }
+
+    std::vector<int16_t> audioBuffer;
+    AudioConverter converter(gainMode, synthesisConfig.fixedGain);
+
+    // Carried across clauses and chunks, so their boundaries don't click
+    Resampler resampler(synthesisConfig.sampleRate, synthesisConfig.outputRate());
+    std::vector<int16_t> resampled;
+    auto emit = [&](const int16_t *samples, size_t numSamples) {
+        if (resampler.passthrough()) {
+            return onAudio(samples, numSamples);
+        }
+        resampled.clear();
+        resampler.process(samples, numSamples, resampled);
+        return onAudio(resampled.data(), resampled.size());
+    };
+
+    bool firstChunk = true;
+    bool stopped = false;
+    auto deliver = [&](const int16_t *samples, size_t numSamples) {
+        if (firstChunk) {
+            auto firstTime = std::chrono::steady_clock::now();
+            result.firstAudioSeconds =
+                std::chrono::duration<double>(firstTime - startTime).count();
+            firstChunk = false;
+        }
+        stopped = !emit(samples, numSamples);
+        return !stopped;
+    };
+
+    // One piece of a clause as split by splitIdClauses, without its pause
+    auto synthesizePiece = [&](std::vector<int64_t> &phonemeIds) {
+        SynthesisResult clauseResult;
+        result.longestRunIds = std::max(result.longestRunIds, phonemeIds.size());
+        if (chunked) {
+            // Chunks end mid-clause, so only leading silence can be trimmed
+            bool leading = true;
+            chunked->synthesize(phonemeIds, synthesisConfig,
+                                [&](const int16_t *samples, size_t numSamples) {
+                if (leading) {
+                    AudioSpan span = trimSilence(samples, numSamples, synthesisConfig);
+                    if (span.size() == 0) {
+                        return true;
+                    }
+                    samples += span.begin;
+                    numSamples -= span.begin;
+                    leading = false;
+                }
+                return deliver(samples, numSamples);
+            }, clauseResult, &converter);
+            result.inferSeconds += clauseResult.inferSeconds;
+            result.audioSeconds += clauseResult.audioSeconds;
+            return !stopped;
+        }
+
+        const int16_t *samples;
+        size_t numSamples;
+        if (useIoBinding) {
+            // Hand out the bound buffer directly, without a copy
+            numSamples = bound().run(phonemeIds.data(), phonemeIds.size(),
+                                     synthesisConfig, clauseResult, &converter);
+            samples = bound().audio();
+        } else {
+            audioBuffer.clear();
+            Synthesize(phonemeIds, synthesisConfig, m_session, audioBuffer, clauseResult,
+                       &converter);
+            samples = audioBuffer.data();
+            numSamples = audioBuffer.size();
+        }
+        result.inferSeconds += clauseResult.inferSeconds;
+        result.audioSeconds += clauseResult.audioSeconds;
+
+        AudioSpan span = trimSilence(samples, numSamples, synthesisConfig);
+        StageTimer timer(Stage::Output);
+        return span.size() == 0 || deliver(samples + span.begin, span.size());
+    };
+
+    // Pauses are zero samples rather than decoded silence
+    std::vector<int64_t> pieceIds;
+    std::vector<int16_t> silence;
+    size_t maxIds = maxIdsPerRun(m_session, synthesisConfig);
+    auto synthesizeClause = [&](std::vector<int64_t> &phonemeIds) {
+        for (const IdClause &piece : splitIdClauses(phonemeIds, synthesisConfig, maxIds)) {
+            pieceIds.assign(phonemeIds.begin() + piece.begin, phonemeIds.begin() + piece.end);
+            if (!synthesizePiece(pieceIds)) {
+                return false;
+            }
+            silence.assign(clauseSilenceSamples(piece.terminator, synthesisConfig), 0);
+            if (!silence.empty() && !deliver(silence.data(), silence.size())) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Phonemize the whole text first: espeak-ng state is process-global, so
+    // in-process phonemization holds eSpeakMutex, which must not stay taken
+    // while the clauses are synthesized. The helper does it in one round trip.
+    std::vector<std::vector<int64_t>> clauses;
+    if (phonemizerPool) {
+        clauses = phonemizerPool->clauseSequences(text, eSpeakConfig);
+    } else {
+        std::lock_guard<std::mutex> lock(eSpeakMutex());
+        phonemize_eSpeak_clauses(text, eSpeakConfig, [&](PhonemeClause &clause) {
+            if (!clause.phonemes.empty()) {
+                clauses.push_back(phonemes_to_sequence(clause_phonemes(clause, eSpeakConfig)));
+            }
+            return true;
+        });
+    }
+    for (std::vector<int64_t> &phonemeIds : clauses) {
+        if (!synthesizeClause(phonemeIds)) {
+            break;
+        }
+    }
+
+    if (!resampler.passthrough() && !stopped) {
+        resampled.clear();
+        resampler.flush(resampled);
+        if (!resampled.empty()) {
+            onAudio(resampled.data(), resampled.size());
+        }
+    }
+
+    result.predictedPeakBytes =
+        predictedRunBytes(m_session, result.longestRunIds, synthesisConfig);
+    if (result.audioSeconds > 0) {
+        result.realTimeFactor = result.inferSeconds / result.audioSeconds;
+    }
+}
@@ -0,0 +1,71 @@
+// Picks the fastest onnxruntime session settings for this machine and writes
+// them next to the model, where VitsONNX and SessionPool load them at startup.
+//
+// Usage: vits_autotune [model.onnx] [texts.txt] [output.tuning]
+//   texts.txt: one sentence per line (default: built-in short/medium/long set)
+//   output.tuning: defaults to <model.onnx>.tuning
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "session_tuning.h"
+#include "vits_onnx.h"
+
+static const char *DEFAULT_TEXTS[] = {
+    "Hello there.",
+    "The quick brown fox jumps over the lazy dog, "
+    "while the patient cat waits by the window.",
+    "It was a bright cold day in April, and the clocks were striking thirteen. "
+    "Winston Smith, his chin nuzzled into his breast in an effort to escape the "
+    "vile wind, slipped quickly through the glass doors of Victory Mansions, "
+    "though not quickly enough to prevent a swirl of gritty dust from entering "
+    "along with him.",
+};
+
+int main(int argc, char **argv) {
+    std::string modelPath = (argc > 1) ? argv[1] : "vits2_model.onnx";
+    std::string textsPath = (argc > 2) ? argv[2] : "";
+    std::string outputPath = (argc > 3) ? argv[3] : defaultTuningPath(modelPath);
+
+    std::vector<std::string> texts;
+    if (textsPath.empty()) {
+        texts.assign(std::begin(DEFAULT_TEXTS), std::end(DEFAULT_TEXTS));
+    } else {
+        std::ifstream file(textsPath);
+        if (!file) {
+            std::cerr << "Failed to open " << textsPath << std::endl;
+            return 1;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty()) {
+                texts.push_back(line);
+            }
+        }
+    }
+
+    // Phonemize once; only the session settings vary between candidates
+    initializeESpeak("espeak-ng/share/espeak-ng-data/");
+    eSpeakPhonemeConfig eSpeakConfig;
+    std::vector<std::vector<int64_t>> corpus;
+    for (const std::string &text : texts) {
+        corpus.push_back(text_to_sequence(text, eSpeakConfig));
+    }
+
+    AutotuneOptions options;
+    std::vector<AutotuneMeasurement> measurements;
+    SessionTuning best = autotuneSession(modelPath, corpus, options, measurements);
+
+    std::cout << "tuning\tload_s\tinfer_s\taudio_s\trtf" << std::endl;
+    for (const AutotuneMeasurement &m : measurements) {
+        std::cout << describeSessionTuning(m.tuning) << "\t" << m.loadSeconds << "\t"
+                  << m.inferSeconds << "\t" << m.audioSeconds << "\t"
+                  << m.realTimeFactor << std::endl;
+    }
+
+    saveSessionTuning(outputPath, best);
+    std::cout << "Best: " << describeSessionTuning(best) << std::endl;
+    std::cout << "Wrote " << outputPath << std::endl;
+    return 0;
+}
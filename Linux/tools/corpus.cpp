@@ -0,0 +1,295 @@
+// Synthesizes every item of a JSONL/TSV manifest (see readCorpusManifest) to
+// its own audio file, split across worker threads or processes, and prints
+// the aggregate throughput.
+//
+// Usage: vits_corpus [--model vits2_model.onnx] [--name "{id}.wav"]
+//                    [--workers 1] [--processes] [--shard K/N] [--rate 16000]
+//                    [--checkpoint DIR] [--intra-op-threads N]
+//                    [--memory-budget-mb 512] [--phonemizers N]
+//                    manifest.jsonl out_dir
+//
+// Worker threads share one session (Run is thread-safe), so the weights
+// are loaded once. Their G2P serializes on eSpeakMutex unless
+// --phonemizers hands it to that many PhonemizerPool helpers. With
+// --processes every worker is a forked process with its own espeak-ng and
+// its own copy of the session, so --phonemizers is rejected there. --shard K/N keeps only manifest items with
+// index % N == K, for splitting one corpus across machines.
+//
+// Files are written as "<name>.part" and renamed once complete, then
+// recorded in the checkpoint directory (default out_dir/.progress). A rerun
+// with the same manifest skips every recorded item, so an interrupted run
+// resumes where it stopped.
+//
+// Prints a TSV report:
+//   items  skipped  failed  audio_s  wall_s  audio_s_per_wall_s
+// where items and audio_s count only what this run synthesized.
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_sink.h"
+#include "corpus.h"
+#include "phonemize.h"
+#include "phonemizer_pool.h"
+#include "resampler.h"
+#include "silence.h"
+
+namespace fs = std::filesystem;
+
+struct CorpusOptions {
+  std::string modelPath = "vits2_model.onnx";
+  std::string espeakDataPath = "espeak-ng/share/espeak-ng-data/";
+  std::string namePattern = "{id}.wav";
+  std::string outputDirectory;
+  std::string checkpointDirectory;
+  std::string workerPrefix = "w";
+  int intraOpThreads = 0;
+  uint64_t memoryBudgetBytes = 0;
+  size_t phonemizerWorkers = 0;
+  SynthesisConfig synthesisConfig;
+};
+
+static void loadCorpusSession(const CorpusOptions &options, ModelSession &session) {
+    session.memoryBudget.maxBytes = options.memoryBudgetBytes;
+    loadSessionTuning(defaultTuningPath(options.modelPath), session.tuning);
+    if (options.intraOpThreads > 0) {
+        session.tuning.intraOpThreads = options.intraOpThreads;
+    }
+    loadModel(options.modelPath, session, false);
+}
+
+// Synthesizes items[worker], items[worker + numWorkers], ... on session,
+// phonemizing text on phonemizerPool if given; failures are logged and
+// left out of the checkpoint
+static void runWorker(const CorpusOptions &options, ModelSession &session,
+                      PhonemizerPool *phonemizerPool, const std::vector<CorpusItem> &items,
+                      size_t worker, size_t numWorkers) {
+    CorpusCheckpoint checkpoint(options.checkpointDirectory,
+                                options.workerPrefix + std::to_string(worker));
+    eSpeakPhonemeConfig eSpeakConfig;
+    for (size_t i = worker; i < items.size(); i += numWorkers) {
+        const CorpusItem &item = items[i];
+        try {
+            std::vector<int64_t> phonemeIds = item.phonemeIds;
+            if (phonemeIds.empty() && phonemizerPool) {
+                phonemeIds = phonemizerPool->textToSequence(item.text, eSpeakConfig);
+            } else if (phonemeIds.empty()) {
+                std::lock_guard<std::mutex> lock(eSpeakMutex());
+                phonemeIds = text_to_sequence(item.text, eSpeakConfig);
+            }
+
+            SynthesisConfig synthesisConfig = options.synthesisConfig;
+            if (item.speakerId) {
+                synthesisConfig.speakerId = item.speakerId;
+            }
+            std::vector<int16_t> audioBuffer;
+            SynthesisResult result;
+            SynthesizeClauses(phonemeIds, synthesisConfig, session, audioBuffer, result);
+            resampleAudio(audioBuffer, synthesisConfig.sampleRate, synthesisConfig.outputRate());
+
+            fs::path path =
+                fs::path(options.outputDirectory) / corpusOutputName(options.namePattern, item);
+            fs::create_directories(path.parent_path());
+            // The format follows the final name, not the .part suffix
+            std::string partPath = path.string() + ".part";
+            std::unique_ptr<AudioSink> sink;
+            if (isRawPcmPath(path.string())) {
+                sink = std::make_unique<PcmSink>(partPath);
+            } else {
+                sink = std::make_unique<WavFileSink>(partPath, synthesisConfig.outputRate(),
+                                                     synthesisConfig.channels);
+            }
+            sink->write(audioBuffer.data(), audioBuffer.size());
+            sink->close();
+            fs::rename(partPath, path);
+            checkpoint.markDone(item.id, result.audioSeconds);
+        } catch (const std::exception &e) {
+            std::cerr << item.id << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    CorpusOptions options;
+    std::string manifestPath;
+    size_t numWorkers = 1;
+    bool useProcesses = false;
+    size_t shard = 0;
+    size_t numShards = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--model" && hasValue) {
+            options.modelPath = argv[++i];
+        } else if (arg == "--name" && hasValue) {
+            options.namePattern = argv[++i];
+        } else if (arg == "--workers" && hasValue) {
+            numWorkers = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--processes") {
+            useProcesses = true;
+        } else if (arg == "--shard" && hasValue) {
+            std::string value = argv[++i];
+            size_t slash = value.find('/');
+            if (slash == std::string::npos) {
+                std::cerr << "--shard expects K/N" << std::endl;
+                return 1;
+            }
+            shard = std::stoul(value.substr(0, slash));
+            numShards = std::stoul(value.substr(slash + 1));
+            if (numShards == 0 || shard >= numShards) {
+                std::cerr << "--shard K/N needs 0 <= K < N" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rate" && hasValue) {
+            options.synthesisConfig.outputSampleRate = std::stoi(argv[++i]);
+        } else if (arg == "--checkpoint" && hasValue) {
+            options.checkpointDirectory = argv[++i];
+        } else if (arg == "--intra-op-threads" && hasValue) {
+            options.intraOpThreads = std::stoi(argv[++i]);
+        } else if (arg == "--memory-budget-mb" && hasValue) {
+            options.memoryBudgetBytes = std::stoull(argv[++i]) << 20;
+        } else if (arg == "--phonemizers" && hasValue) {
+            options.phonemizerWorkers = std::stoul(argv[++i]);
+        } else if (manifestPath.empty()) {
+            manifestPath = arg;
+        } else if (options.outputDirectory.empty()) {
+            options.outputDirectory = arg;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (manifestPath.empty() || options.outputDirectory.empty()) {
+        std::cerr << "Usage: vits_corpus [--model m.onnx] [--name PATTERN] [--workers N] "
+                     "[--processes] [--shard K/N] [--rate HZ] [--checkpoint DIR] "
+                     "[--intra-op-threads N] [--memory-budget-mb MB] [--phonemizers N] "
+                     "manifest.jsonl out_dir" << std::endl;
+        return 1;
+    }
+    if (useProcesses && options.phonemizerWorkers > 0) {
+        std::cerr << "--phonemizers only applies to worker threads, not --processes"
+                  << std::endl;
+        return 1;
+    }
+    if (options.checkpointDirectory.empty()) {
+        options.checkpointDirectory = (fs::path(options.outputDirectory) / ".progress").string();
+    }
+    // Shards sharing a checkpoint directory must not share progress files
+    options.workerPrefix = "s" + std::to_string(shard) + "-w";
+
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<CorpusItem> items;
+    try {
+        items = readCorpusManifest(manifestPath);
+        fs::create_directories(options.checkpointDirectory);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unordered_map<std::string, double> finished =
+        CorpusCheckpoint::finishedItems(options.checkpointDirectory);
+    std::vector<CorpusItem> pending;
+    size_t skipped = 0;
+    for (CorpusItem &item : items) {
+        if (item.index % numShards != shard) {
+            continue;
+        }
+        if (finished.count(item.id) > 0) {
+            skipped++;
+        } else {
+            pending.push_back(std::move(item));
+        }
+    }
+    numWorkers = std::min(numWorkers, pending.size());
+
+    if (useProcesses) {
+        // Forked before espeak-ng and onnxruntime start their threads
+        std::vector<pid_t> children;
+        for (size_t w = 0; w < numWorkers; w++) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                std::cerr << "Failed to fork corpus worker" << std::endl;
+                break;
+            }
+            if (pid == 0) {
+                try {
+                    initializeESpeak(options.espeakDataPath);
+                    ModelSession session;
+                    loadCorpusSession(options, session);
+                    runWorker(options, session, nullptr, pending, w, numWorkers);
+                } catch (const std::exception &e) {
+                    std::cerr << e.what() << std::endl;
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            children.push_back(pid);
+        }
+        for (pid_t pid : children) {
+            waitpid(pid, nullptr, 0);
+        }
+    } else if (numWorkers > 0) {
+        std::unique_ptr<PhonemizerPool> phonemizerPool;
+        ModelSession session;
+        try {
+            // Helpers are forked before onnxruntime starts its threads
+            if (options.phonemizerWorkers > 0) {
+                PhonemizerPoolConfig poolConfig;
+                poolConfig.numWorkers = options.phonemizerWorkers;
+                poolConfig.espeakDataPath = options.espeakDataPath;
+                phonemizerPool = std::make_unique<PhonemizerPool>(poolConfig);
+            }
+            initializeESpeak(options.espeakDataPath);
+            loadCorpusSession(options, session);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < numWorkers; w++) {
+            threads.emplace_back([&, w]() {
+                try {
+                    runWorker(options, session, phonemizerPool.get(), pending, w, numWorkers);
+                } catch (const std::exception &e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+    double wallSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    // Workers report through the checkpoint, which also covers processes
+    // that died; whatever wasn't recorded failed
+    std::unordered_map<std::string, double> done =
+        CorpusCheckpoint::finishedItems(options.checkpointDirectory);
+    size_t synthesized = 0;
+    double audioSeconds = 0;
+    for (const CorpusItem &item : pending) {
+        auto found = done.find(item.id);
+        if (found != done.end()) {
+            synthesized++;
+            audioSeconds += found->second;
+        }
+    }
+    size_t failed = pending.size() - synthesized;
+
+    std::cout << "items\tskipped\tfailed\taudio_s\twall_s\taudio_s_per_wall_s" << std::endl;
+    std::cout << synthesized << "\t" << skipped << "\t" << failed << "\t" << audioSeconds
+              << "\t" << wallSeconds << "\t"
+              << (wallSeconds > 0 ? audioSeconds / wallSeconds : 0.0) << std::endl;
+    return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+// Synthesizes a long text document to one audio file through the pipelined
+// DocumentSynthesizer and prints how busy each stage was.
+//
+// Usage: vits_document [--model vits2_model.onnx] [--queue 4]
+//                      [--phonemizers 2] [--rate 16000] [--memory-budget-mb 512]
+//                      input.txt output.wav
+//   output: *.wav, raw *.pcm, or "-" for raw PCM on stdout (the report then
+//   goes to stderr)
+//
+// sequential_s is the sum of the stage busy times, i.e. roughly the wall
+// time of running the stages one after another.
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "audio_sink.h"
+#include "document_synthesizer.h"
+#include "metrics.h"
+#include "phonemizer_pool.h"
+
+int main(int argc, char **argv) {
+    std::string modelPath = "vits2_model.onnx";
+    std::string espeakDataPath = "espeak-ng/share/espeak-ng-data/";
+    std::string inputPath;
+    std::string outputPath;
+    DocumentConfig config;
+    size_t phonemizerWorkers = 0;
+    uint64_t memoryBudgetBytes = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--model" && hasValue) {
+            modelPath = argv[++i];
+        } else if (arg == "--queue" && hasValue) {
+            config.queueDepth = std::stoul(argv[++i]);
+        } else if (arg == "--phonemizers" && hasValue) {
+            phonemizerWorkers = std::stoul(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            config.synthesisConfig.outputSampleRate = std::stoi(argv[++i]);
+        } else if (arg == "--memory-budget-mb" && hasValue) {
+            memoryBudgetBytes = std::stoull(argv[++i]) << 20;
+        } else if (inputPath.empty()) {
+            inputPath = arg;
+        } else if (outputPath.empty()) {
+            outputPath = arg;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (inputPath.empty() || outputPath.empty()) {
+        std::cerr << "Usage: vits_document [--model m.onnx] [--queue N] "
+                     "[--phonemizers N] [--rate HZ] [--memory-budget-mb MB] "
+                     "input.txt output.wav" << std::endl;
+        return 1;
+    }
+
+    std::ifstream input(inputPath);
+    if (!input) {
+        std::cerr << "Cannot open " << inputPath << std::endl;
+        return 1;
+    }
+    std::string document((std::istreambuf_iterator<char>(input)),
+                         std::istreambuf_iterator<char>());
+
+    // Helpers are forked before onnxruntime starts its threads
+    if (phonemizerWorkers > 0) {
+        PhonemizerPoolConfig poolConfig;
+        poolConfig.numWorkers = phonemizerWorkers;
+        poolConfig.espeakDataPath = espeakDataPath;
+        config.phonemizerPool = std::make_shared<PhonemizerPool>(poolConfig);
+    }
+    initializeESpeak(espeakDataPath);
+    ModelSession session;
+    session.memoryBudget.maxBytes = memoryBudgetBytes;
+    loadSessionTuning(defaultTuningPath(modelPath), session.tuning);
+    loadModel(modelPath, session, false);
+
+    const SynthesisConfig &synthesisConfig = config.synthesisConfig;
+    std::unique_ptr<AudioSink> sink =
+        openAudioSink(outputPath, synthesisConfig.outputRate(), synthesisConfig.channels);
+
+    // The only request in this process, so the process-wide peak is its own
+    PeakMemoryScope memoryScope;
+    DocumentSynthesizer synthesizer(session, config);
+    DocumentStats stats = synthesizer.synthesize(
+        document, [&sink](const int16_t *samples, size_t count) {
+            sink->write(samples, count);
+            return true;
+        });
+    sink->close();
+
+    std::ostream &report = (outputPath == "-") ? std::cerr : std::cout;
+    double sequentialSeconds = 0;
+    report << "stage\tbusy_s\tutilization\titems" << std::endl;
+    for (size_t s = 0; s < stats.stages.size(); s++) {
+        const DocumentStageStats &stage = stats.stages[s];
+        sequentialSeconds += stage.busySeconds;
+        report << documentStageName((DocumentStage)s) << "\t" << stage.busySeconds
+               << "\t" << stage.utilization << "\t" << stage.items << std::endl;
+    }
+    report << "sentences\twall_s\tsequential_s\taudio_s\trtf\tpeak_rss_mb" << std::endl;
+    report << stats.sentences << "\t" << stats.wallSeconds << "\t" << sequentialSeconds
+           << "\t" << stats.audioSeconds << "\t"
+           << (stats.audioSeconds > 0 ? stats.wallSeconds / stats.audioSeconds : 0.0)
+           << "\t" << (double)memoryScope.peakBytes() / (1024.0 * 1024.0) << std::endl;
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Local synthesis server (see SynthesisServer for the HTTP interface).
+//
+// Usage: vits_server [--model vits2_model.onnx] [--unix /tmp/vits.sock]
+//                    [--port 5002] [--bind 127.0.0.1] [--workers 2]
+//                    [--io-binding] [--phonemizers 4] [--memory-budget-mb 512]
+//
+// Example:
+//   curl --data 'Hello there.' 'http://127.0.0.1:5002/synthesize?speaker=0' > out.wav
+//   curl --unix-socket /tmp/vits.sock --data 'Hello.' 'http://localhost/synthesize?format=pcm'
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "synthesis_server.h"
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+int main(int argc, char **argv) {
+    SynthesisServerConfig config;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--model" && hasValue) {
+            config.modelPath = argv[++i];
+        } else if (arg == "--unix" && hasValue) {
+            config.unixSocketPath = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            config.tcpPort = std::stoi(argv[++i]);
+        } else if (arg == "--bind" && hasValue) {
+            config.bindAddress = argv[++i];
+        } else if (arg == "--workers" && hasValue) {
+            config.numWorkers = std::stoul(argv[++i]);
+        } else if (arg == "--io-binding") {
+            config.pool.useIoBinding = true;
+        } else if (arg == "--phonemizers" && hasValue) {
+            config.phonemizerWorkers = std::stoul(argv[++i]);
+        } else if (arg == "--memory-budget-mb" && hasValue) {
+            config.pool.memoryBudget.maxBytes = std::stoull(argv[++i]) << 20;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (config.unixSocketPath.empty() && config.tcpPort < 0) {
+        config.tcpPort = 5002;
+    }
+
+    SynthesisServer server(config);
+    server.start();
+    if (!config.unixSocketPath.empty()) {
+        std::cout << "Listening on " << config.unixSocketPath << std::endl;
+    }
+    if (server.tcpPort() >= 0) {
+        std::cout << "Listening on " << config.bindAddress << ":" << server.tcpPort()
+                  << std::endl;
+    }
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    while (!stopRequested) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    server.stop();
+    return 0;
+}
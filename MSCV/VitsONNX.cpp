@@ -29,7 +29,7 @@ VitsONNX::VitsONNX(const std::string& onnx_model_path):m_session(nullptr), m_env
 		std::cerr << "";
 	m_session = Ort::Session(m_env, onnx_model_path_wstr.c_str(), session_options);
 	//PrintModelInfo(m_session);
-	this->phonemizer.Init("en-us");
+	this->phonemizer.Init(this->voice);
 }
 
 
@@ -80,7 +80,8 @@ void VitsONNX::PrintModelInfo(Ort::Session& session)
 
 std::vector < int16_t > VitsONNX::inference(std::string text_input) {
 	std::vector < int16_t > audioBuffer;
-	std::vector<int64_t> phonemeIds = this->phonemizer.text_to_sequence(text_input);
+	std::vector<int64_t> phonemeIds = this->phonemeCache.get(this->voice, text_input,
+		[this](const std::string& text) { return this->phonemizer.text_to_sequence(text); });
 	/*for (int i = 0; i < phonemeIds.size(); i++) {
 		std::cout << phonemeIds[i] << " ";
 	}
@@ -12,6 +12,7 @@
 #include "onnxruntime_cxx_api.h"
 #include "cpu_provider_factory.h"
 #include "phonemize.h"
+#include "phoneme_cache.h"
 
 #include <any>
 #include <map>
@@ -34,6 +35,7 @@ public:
 
 	std::map<std::string, int> getSynthesisConfig();
 	std::vector < int16_t > inference(std::string text_input);
+	PhonemeCacheStats getPhonemeCacheStats() const { return phonemeCache.stats(); }
 	
 private:
 	void PrintModelInfo(Ort::Session& session);
@@ -55,6 +57,8 @@ private:
 
 	const float MAX_WAV_VALUE = 32767.0f;
 
+	std::string voice = "en-us";
 	PhonemizerEngine phonemizer;
+	PhonemeCache phonemeCache;
 };
 
@@ -6,7 +6,13 @@
 
 int main() {
 	const std::string& model_path = "vits2_model.onnx";
-	std::ofstream audioFile("test.wav", std::ios::binary);
+
+	// Load the session and espeak-ng once, then reuse them for every line
+	VitsONNX vitsmodel(model_path);
+	std::map<std::string, int> synthesisConfig = vitsmodel.getSynthesisConfig();
+
+	// Every line is appended to the same test.wav under a single header
+	WavFileWriter audioFile("test.wav", synthesisConfig["sampleRate"], synthesisConfig["sampleWidth"], synthesisConfig["channels"]);
 
 	while (true){
 	std::string text = "";
@@ -18,13 +24,10 @@ int main() {
 		break;
 	}
 
-	VitsONNX vitsmodel(model_path);
-	std::map<std::string, int> synthesisConfig = vitsmodel.getSynthesisConfig();
-
 	std::vector < int16_t > audio = vitsmodel.inference(text);
 	//std::cout << synthesisConfig["sampleWidth"];
-	writeWavHeader(synthesisConfig["sampleRate"], synthesisConfig["sampleWidth"], synthesisConfig["channels"], (int32_t)audio.size(), audioFile);
-	audioFile.write((const char*)audio.data(), sizeof(int16_t) * audio.size());
+	audioFile.write(audio.data(), audio.size());
+	audioFile.updateHeader();
 	}
 	return 0;
 }
\ No newline at end of file
@@ -1,13 +1,6 @@
 #include "phonemize.h"
 
 
-// convert UTF-8 string to wstring
-static std::wstring utf8_to_wstring(const std::string& str) {
-    std::wstring_convert<std::codecvt_utf8<wchar_t>> myconv;
-    return myconv.from_bytes(str);
-}
-
-
 PhonemizerEngine::PhonemizerEngine() {
 }
 void PhonemizerEngine::Init(std::string voice) {
@@ -30,14 +23,7 @@ PhonemizerEngine::~PhonemizerEngine() {
 std::vector<int64_t> PhonemizerEngine::text_to_sequence(const std::string& text) {
     std::vector<int64_t> sequence;
     std::string clean_text = phonemize_eSpeak(text);
-    std::wstring clean_text_wstring = utf8_to_wstring(clean_text);
-
-    for (char16_t symbol : clean_text_wstring) {
-        if (this->_symbol_to_id.count(symbol) > 0) {
-            int symbol_id = _symbol_to_id[symbol];
-            sequence.push_back(symbol_id);
-        } 
-    }
+    utf8ToSymbolIds(clean_text.data(), clean_text.size(), sequence);
     return sequence;
 }
 
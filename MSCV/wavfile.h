@@ -1,7 +1,9 @@
 #ifndef WAVFILE_H_
 #define WAVFILE_H_
 
+#include <fstream>
 #include <iostream>
+#include <string>
 
 struct WavHeader {
     uint8_t RIFF[4] = { 'R', 'I', 'F', 'F' };
@@ -37,4 +39,45 @@ static void writeWavHeader(int sampleRate, int sampleWidth, int channels,
 
 } /* writeWavHeader */
 
+// Streams PCM into one WAV file. The header starts out with zero sizes and
+// is rewritten by updateHeader()/close(), so utterances can be appended one
+// after another without knowing the total length up front.
+class WavFileWriter {
+public:
+    WavFileWriter(const std::string& path, int sampleRate, int sampleWidth, int channels)
+        : m_file(path, std::ios::binary | std::ios::trunc), m_sampleRate(sampleRate),
+          m_sampleWidth(sampleWidth), m_channels(channels) {
+        writeWavHeader(m_sampleRate, m_sampleWidth, m_channels, 0, m_file);
+    }
+    ~WavFileWriter() { close(); }
+
+    void write(const int16_t* samples, size_t numSamples) {
+        m_file.write((const char*)samples, sizeof(int16_t) * numSamples);
+        m_numSamples += (uint32_t)numSamples;
+    }
+
+    // Patches the sizes so the file is playable as it stands
+    void updateHeader() {
+        std::streampos end = m_file.tellp();
+        m_file.seekp(0);
+        writeWavHeader(m_sampleRate, m_sampleWidth, m_channels, m_numSamples / m_channels, m_file);
+        m_file.seekp(end);
+        m_file.flush();
+    }
+
+    void close() {
+        if (m_file.is_open()) {
+            updateHeader();
+            m_file.close();
+        }
+    }
+
+private:
+    std::ofstream m_file;
+    int m_sampleRate;
+    int m_sampleWidth;
+    int m_channels;
+    uint32_t m_numSamples = 0;
+};
+
 #endif // WAVFILE_H_
\ No newline at end of file
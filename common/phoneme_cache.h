@@ -0,0 +1,145 @@
+#ifndef PHONEME_CACHE_H_
+#define PHONEME_CACHE_H_
+
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct PhonemeCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// Bounded, thread-safe LRU cache of text -> phoneme id results, keyed by
+// (voice, normalized text). Shared by the Linux and Windows builds.
+//
+// Misses call the supplied phonemizer without holding the cache lock, so the
+// caller is still responsible for serializing espeak-ng.
+class PhonemeCache
+{
+public:
+    typedef std::function<std::vector<int64_t>(const std::string &)> Phonemizer;
+
+    explicit PhonemeCache(size_t maxBytes = 16 * 1024 * 1024) : m_maxBytes(maxBytes) {}
+    PhonemeCache(const PhonemeCache &) = delete;
+    PhonemeCache &operator=(const PhonemeCache &) = delete;
+
+    std::vector<int64_t> get(const std::string &voice, const std::string &text,
+                             const Phonemizer &phonemize) {
+        std::string normalized = normalize(text);
+        std::string key = voice;
+        key += '\0';
+        key += normalized;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_index.find(key);
+            if (it != m_index.end()) {
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                m_hits++;
+                return it->second->phonemeIds;
+            }
+        }
+        m_misses++;
+
+        std::vector<int64_t> phonemeIds = phonemize(normalized);
+        insert(std::move(key), phonemeIds);
+        return phonemeIds;
+    }
+
+    PhonemeCacheStats stats() const {
+        PhonemeCacheStats stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats.evictions = m_evictions;
+        stats.entries = m_entries.size();
+        stats.bytes = m_bytes;
+        return stats;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_index.clear();
+        m_entries.clear();
+        m_bytes = 0;
+    }
+
+    // Collapses whitespace runs and trims both ends, so prompts that differ
+    // only in spacing share an entry. Misses phonemize the normalized text.
+    static std::string normalize(const std::string &text) {
+        std::string normalized;
+        normalized.reserve(text.size());
+        bool pendingSpace = false;
+        for (char c : text) {
+            if (std::isspace((unsigned char)c)) {
+                pendingSpace = !normalized.empty();
+                continue;
+            }
+            if (pendingSpace) {
+                normalized += ' ';
+                pendingSpace = false;
+            }
+            normalized += c;
+        }
+        return normalized;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::vector<int64_t> phonemeIds;
+    };
+
+    // Key stored twice (list + index) plus the ids and node overhead
+    static size_t entryBytes(const Entry &entry) {
+        return 2 * entry.key.size() + entry.phonemeIds.size() * sizeof(int64_t) + 128;
+    }
+
+    void insert(std::string key, const std::vector<int64_t> &phonemeIds) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_index.count(key) > 0) {
+            // Another thread phonemized the same text meanwhile
+            return;
+        }
+
+        Entry entry{std::move(key), phonemeIds};
+        size_t bytes = entryBytes(entry);
+        if (bytes > m_maxBytes) {
+            return;
+        }
+
+        while (!m_entries.empty() && m_bytes + bytes > m_maxBytes) {
+            Entry &oldest = m_entries.back();
+            m_bytes -= entryBytes(oldest);
+            m_index.erase(oldest.key);
+            m_entries.pop_back();
+            m_evictions++;
+        }
+
+        m_entries.push_front(std::move(entry));
+        m_index[m_entries.front().key] = m_entries.begin();
+        m_bytes += bytes;
+    }
+
+    size_t m_maxBytes;
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t m_bytes = 0;
+    uint64_t m_evictions = 0;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+};
+
+#endif // PHONEME_CACHE_H_
@@ -0,0 +1,142 @@
+#ifndef SYMBOLS_H_
+#define SYMBOLS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Model symbol inventory shared by the Linux and Windows builds.
+// SYMBOLS[id] is the codepoint for that id; 0 marks an unused id.
+constexpr char32_t SYMBOLS[] = {
+    U'_', U';', U':', U',', U'.', U'!', U'?', U'¡', U'¿', U'—',
+    U'…', U'"', U'«', U'»', U'“', U'”', U' ', U'A', U'B', U'C',
+    U'D', U'E', U'F', U'G', U'H', U'I', U'J', U'K', U'L', U'M',
+    U'N', U'O', U'P', U'Q', U'R', U'S', U'T', U'U', U'V', U'W',
+    U'X', U'Y', U'Z', U'a', U'b', U'c', U'd', U'e', U'f', U'g',
+    U'h', U'i', U'j', U'k', U'l', U'm', U'n', U'o', U'p', U'q',
+    U'r', U's', U't', U'u', U'v', U'w', U'x', U'y', U'z', U'ɑ',
+    U'ɐ', U'ɒ', U'æ', U'ɓ', U'ʙ', U'β', U'ɔ', U'ɕ', U'ç', U'ɗ',
+    U'ɖ', U'ð', U'ʤ', U'ə', U'ɘ', U'ɚ', U'ɛ', U'ɜ', U'ɝ', U'ɞ',
+    U'ɟ', U'ʄ', U'ɡ', U'ɠ', U'ɢ', U'ʛ', U'ɦ', U'ɧ', U'ħ', U'ɥ',
+    U'ʜ', U'ɨ', U'ɪ', U'ʝ', U'ɭ', U'ɬ', U'ɫ', U'ɮ', U'ʟ', U'ɱ',
+    U'ɯ', U'ɰ', U'ŋ', U'ɳ', U'ɲ', U'ɴ', U'ø', U'ɵ', U'ɸ', U'θ',
+    U'œ', U'ɶ', U'ʘ', U'ɹ', U'ɺ', U'ɾ', U'ɻ', U'ʀ', U'ʁ', U'ɽ',
+    U'ʂ', U'ʃ', U'ʈ', U'ʧ', U'ʉ', U'ʊ', U'ʋ', U'ⱱ', U'ʌ', U'ɣ',
+    U'ɤ', U'ʍ', U'χ', U'ʎ', U'ʏ', U'ʑ', U'ʐ', U'ʒ', U'ʔ', U'ʡ',
+    U'ʕ', U'ʢ', U'ǀ', U'ǁ', U'ǂ', U'ǃ', U'ˈ', U'ˌ', U'ː', U'ˑ',
+    U'ʼ', U'ʴ', U'ʰ', U'ʱ', U'ʲ', U'ʷ', U'ˠ', U'ˤ', U'˞', U'↓',
+    U'↑', U'→', U'↗', U'↘', 0, U'\u0329', 0, U'ᵻ'
+};
+
+constexpr size_t NUM_SYMBOLS = sizeof(SYMBOLS) / sizeof(SYMBOLS[0]);
+
+// Codepoint -> id lookup as a two-level table of 256-entry pages. Only pages
+// holding a symbol are stored; page 0 is all-invalid and backs the rest.
+struct SymbolTable {
+  static constexpr uint8_t INVALID = 0xFF;
+  static constexpr size_t NUM_PAGE_SLOTS = 0x2D; // covers up to U+2CFF
+  static constexpr size_t MAX_PAGES = 9;
+
+  uint8_t pageIndex[NUM_PAGE_SLOTS] = {};
+  uint8_t pages[MAX_PAGES][256] = {};
+};
+
+constexpr SymbolTable buildSymbolTable() {
+  SymbolTable table{};
+  for (size_t page = 0; page < SymbolTable::MAX_PAGES; page++) {
+    for (size_t i = 0; i < 256; i++) {
+      table.pages[page][i] = SymbolTable::INVALID;
+    }
+  }
+
+  size_t usedPages = 1;
+  for (size_t id = 0; id < NUM_SYMBOLS; id++) {
+    char32_t codepoint = SYMBOLS[id];
+    if (codepoint == 0) {
+      continue;
+    }
+    size_t slot = codepoint >> 8;
+    if (table.pageIndex[slot] == 0) {
+      table.pageIndex[slot] = (uint8_t)usedPages++;
+    }
+    table.pages[table.pageIndex[slot]][codepoint & 0xFF] = (uint8_t)id;
+  }
+  return table;
+}
+
+constexpr SymbolTable SYMBOL_TABLE = buildSymbolTable();
+
+constexpr char32_t maxSymbol() {
+  char32_t maxCodepoint = 0;
+  for (size_t id = 0; id < NUM_SYMBOLS; id++) {
+    maxCodepoint = (SYMBOLS[id] > maxCodepoint) ? SYMBOLS[id] : maxCodepoint;
+  }
+  return maxCodepoint;
+}
+
+static_assert(NUM_SYMBOLS < SymbolTable::INVALID, "ids must fit in uint8_t");
+static_assert(maxSymbol() < SymbolTable::NUM_PAGE_SLOTS * 256,
+              "page slots must cover every symbol");
+
+// Returns the model id for a codepoint, or -1 if it is not a model symbol
+inline int symbolToId(char32_t codepoint) {
+  if (codepoint >= SymbolTable::NUM_PAGE_SLOTS * 256) {
+    return -1;
+  }
+  uint8_t id = SYMBOL_TABLE.pages[SYMBOL_TABLE.pageIndex[codepoint >> 8]][codepoint & 0xFF];
+  return (id == SymbolTable::INVALID) ? -1 : id;
+}
+
+// Decodes UTF-8 phonemes straight into model ids in one pass, dropping
+// codepoints that are not model symbols and skipping malformed bytes.
+inline void utf8ToSymbolIds(const char *text, size_t length,
+                            std::vector<int64_t> &ids) {
+  const unsigned char *p = (const unsigned char *)text;
+  const unsigned char *end = p + length;
+  ids.reserve(ids.size() + length);
+
+  while (p < end) {
+    char32_t codepoint;
+    size_t extra;
+    if (p[0] < 0x80) {
+      codepoint = p[0];
+      extra = 0;
+    } else if ((p[0] & 0xE0) == 0xC0) {
+      codepoint = p[0] & 0x1F;
+      extra = 1;
+    } else if ((p[0] & 0xF0) == 0xE0) {
+      codepoint = p[0] & 0x0F;
+      extra = 2;
+    } else if ((p[0] & 0xF8) == 0xF0) {
+      codepoint = p[0] & 0x07;
+      extra = 3;
+    } else {
+      p++;
+      continue;
+    }
+
+    if ((size_t)(end - p) <= extra) {
+      break;
+    }
+    bool valid = true;
+    for (size_t i = 1; i <= extra; i++) {
+      if ((p[i] & 0xC0) != 0x80) {
+        valid = false;
+        break;
+      }
+      codepoint = (codepoint << 6) | (p[i] & 0x3F);
+    }
+    if (!valid) {
+      p++;
+      continue;
+    }
+    p += extra + 1;
+
+    int id = symbolToId(codepoint);
+    if (id >= 0) {
+      ids.push_back(id);
+    }
+  }
+}
+
+#endif // SYMBOLS_H_